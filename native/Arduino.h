@@ -0,0 +1,162 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Minimal Arduino API for the host-native build of the bridge.
+// Only what LX200WifiBridge and its modules use is provided.
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cstdarg>
+#include <cstddef>
+#include <string>
+
+typedef uint8_t byte;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+#define LOW          0
+#define HIGH         1
+#define INPUT        0
+#define INPUT_PULLUP 2
+
+#define D4  4
+#define D5  5
+#define D6  6
+#define D7  7
+#define D10 10
+
+#define PROGMEM
+#define F(s) (s)
+
+#define SERIAL_8N1 0x800001c
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void esp_restart();
+
+#ifndef __GLIBC_PREREQ
+#define __GLIBC_PREREQ(a, b) 0
+#endif
+#if !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size);
+#endif
+
+// ---- String -------------------------------------------------------------
+class String {
+  public:
+    String(const char *s = "") : s(s ? s : "") {}
+    String(const std::string &s) : s(s) {}
+    explicit String(char c) : s(1, c) {}
+    explicit String(int v) : s(std::to_string(v)) {}
+    explicit String(unsigned long v) : s(std::to_string(v)) {}
+
+    size_t length() const { return s.size(); }
+    const char *c_str() const { return s.c_str(); }
+    char operator[](size_t i) const { return s[i]; }
+    char charAt(size_t i) const { return i < s.size() ? s[i] : 0; }
+
+    bool operator==(const String &o) const { return s == o.s; }
+    bool operator==(const char *o) const { return s == o; }
+    bool operator!=(const String &o) const { return s != o.s; }
+    bool operator!=(const char *o) const { return s != o; }
+
+    String &operator+=(char c) { s += c; return *this; }
+    String &operator+=(const char *o) { s += o; return *this; }
+    String &operator+=(const String &o) { s += o.s; return *this; }
+    String operator+(const String &o) const { return String(s + o.s); }
+    bool concat(char c) { s += c; return true; }
+    bool reserve(size_t n) { s.reserve(n); return true; }
+
+    int indexOf(char c) const { size_t p = s.find(c); return p == std::string::npos ? -1 : (int)p; }
+    String substring(size_t from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+    String substring(size_t from, size_t to) const { return from < to && from < s.size() ? String(s.substr(from, to - from)) : String(); }
+    bool startsWith(const char *p) const { return s.compare(0, strlen(p), p) == 0; }
+    bool endsWith(const char *p) const { size_t n = strlen(p); return s.size() >= n && s.compare(s.size() - n, n, p) == 0; }
+    void remove(size_t index) { if (index < s.size()) s.erase(index); }
+    void remove(size_t index, size_t count) { if (index < s.size()) s.erase(index, count); }
+    void trim();
+    long toInt() const { return strtol(s.c_str(), nullptr, 10); }
+
+  private:
+    std::string s;
+};
+
+// ---- Print / Stream -----------------------------------------------------
+class Print;
+
+class Printable {
+  public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buf, size_t n);
+    size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+    size_t write(const char *s, size_t n) { return write((const uint8_t *)s, n); }
+    virtual void flush() {}
+
+    size_t print(const char *s) { return write(s); }
+    size_t print(const String &s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v) { return printf("%d", v); }
+    size_t print(unsigned int v) { return printf("%u", v); }
+    size_t print(long v) { return printf("%ld", v); }
+    size_t print(unsigned long v) { return printf("%lu", v); }
+    size_t print(double v) { return printf("%.2f", v); }
+    size_t print(const Printable &p) { return p.printTo(*this); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+
+    size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() { return -1; }
+    size_t readBytes(uint8_t *buf, size_t n);
+};
+
+// ---- HardwareSerial -----------------------------------------------------
+typedef void (*OnReceiveCb)();
+
+class HardwareSerial : public Stream {
+  public:
+    virtual void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1) {
+      (void)config; (void)rxPin; (void)txPin; baudRate = baud;
+    }
+    virtual void end() {}
+    virtual void updateBaudRate(unsigned long baud) { baudRate = baud; }
+    unsigned long baudRate_() const { return baudRate; }
+    virtual void onReceive(OnReceiveCb cb, bool onlyOnTimeout = false) { (void)cb; (void)onlyOnTimeout; }
+    size_t setRxBufferSize(size_t n) { return n; }
+    int availableForWrite() { return 1024; }
+    virtual bool setRxTimeout(uint8_t symbols) { (void)symbols; return true; }
+    operator bool() const { return true; }
+
+    int available() override { return 0; }
+    int read() override { return -1; }
+    size_t write(uint8_t c) override;
+    using Print::write;
+
+  protected:
+    unsigned long baudRate = 115200;
+};
+
+extern HardwareSerial &Serial;
+extern HardwareSerial &Serial1;
+
+#endif // NATIVE_ARDUINO_H
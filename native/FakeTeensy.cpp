@@ -0,0 +1,377 @@
+#include "FakeTeensy.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+static unsigned long envOr(const char *name, unsigned long def) {
+  const char *v = getenv(name);
+  return v ? strtoul(v, nullptr, 10) : def;
+}
+
+FakeTeensy::FakeTeensy() {}
+
+// CRC-16/CCITT-FALSE, as the LX200Handler computes it for ":XE#" echoes
+static uint16_t crc16(const std::string &data) {
+  uint16_t crc = 0xFFFF;
+  for (char c : data) {
+    crc ^= (uint16_t)(uint8_t)c << 8;
+    for (int b = 0; b < 8; b++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// Tuned here rather than at construction, so a test can set the
+// environment before setup()
+void FakeTeensy::begin(unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin) {
+  std::lock_guard<std::mutex> l(lock);
+  delayUs = envOr("FAKE_TEENSY_DELAY_US", 1500);
+  ackUs = envOr("FAKE_TEENSY_ACK_US", 200);
+  sessionSupported = envOr("FAKE_TEENSY_SESSION", 1) != 0;
+  bareBool = envOr("FAKE_TEENSY_BARE_BOOL", 0) != 0;
+  dropEvery = envOr("FAKE_TEENSY_DROP_EVERY", 0);
+  slowEvery = envOr("FAKE_TEENSY_SLOW_EVERY", 0);
+  slowUs = envOr("FAKE_TEENSY_SLOW_US", 100000);
+  baudSupported = envOr("FAKE_TEENSY_BAUD", 1) != 0;
+  maxBaud = envOr("FAKE_TEENSY_MAX_BAUD", 921600);
+  framesSupported = envOr("FAKE_TEENSY_FRAMES", 1) != 0;
+  corruptEvery = envOr("FAKE_TEENSY_CORRUPT_EVERY", 0);
+  rebootUs = envOr("FAKE_TEENSY_REBOOT_MS", 0) * 1000ULL;
+  rebootAt = micros() + rebootUs;
+  if (getenv("FAKE_TEENSY_SCRIPT")) loadScript(getenv("FAKE_TEENSY_SCRIPT"));
+  HardwareSerial::begin(baud, config, rxPin, txPin);
+  baseBaud = teensyBaud = baud;
+  rx.clear();
+}
+
+void FakeTeensy::updateBaudRate(unsigned long baud) {
+  std::lock_guard<std::mutex> l(lock);
+  baudRate = baud;
+}
+
+void FakeTeensy::onReceive(OnReceiveCb cb, bool onlyOnTimeout) {
+  (void)onlyOnTimeout;
+  std::lock_guard<std::mutex> l(lock);
+  rxCallback = cb;
+  if (!receiveStarted) {
+    receiveStarted = true;
+    std::thread(&FakeTeensy::receiveTask, this).detach();
+  }
+  rxChanged.notify_one();
+}
+
+bool FakeTeensy::setRxTimeout(uint8_t symbols) {
+  std::lock_guard<std::mutex> l(lock);
+  rxTimeoutSymbols = symbols;
+  return true;
+}
+
+// 8N1: ten bits on the wire per byte
+uint64_t FakeTeensy::byteTimeUs(unsigned long baud) const {
+  return 10000000ULL / baud;
+}
+
+// A trial rate that was never committed falls back to the previous one
+void FakeTeensy::checkBaudTrial(uint64_t now) {
+  if (trialPending && now >= trialUntil) {
+    teensyBaud = trialPrevBaud;
+    trialPending = false;
+  }
+}
+
+// The LX200Handler comes back at its base rate and knows nothing of the
+// session, frames or a baud trial. The boot leaves some noise on its TX
+// line, garbage to a bridge still at a raised rate.
+void FakeTeensy::checkReboot(uint64_t now) {
+  if (rebootUs == 0 || now < rebootAt) return;
+  rebootAt = now + rebootUs;
+  teensyBaud = baseBaud;
+  queueReply(std::string(8, '\0'), now);
+  trialPending = false;
+  session = false;
+  framesOn = false;
+  handshaken = false;
+  inCommand = false;
+  cmdFrame.reset();
+}
+
+static std::string fromHex(const std::string &hex) {
+  std::string out;
+  for (size_t i = 0; i + 1 < hex.size(); i += 2) out += (char)strtoul(hex.substr(i, 2).c_str(), nullptr, 16);
+  return out;
+}
+
+// One captured exchange a line: command payload, packed flag and reply
+// payload, the payloads in hex
+void FakeTeensy::loadScript(const char *path) {
+  script.clear();
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string cmd, reply;
+    int packed = 0;
+    if (!(fields >> cmd >> packed)) continue;
+    fields >> reply;
+    script[fromHex(cmd)].push_back({ packed != 0, fromHex(reply) });
+  }
+}
+
+// The next captured reply to the same command frame, sent under this seq.
+// False once they have all been used.
+bool FakeTeensy::scriptedReply(const std::string &cmd, int seq, uint64_t start) {
+  uint8_t frame[FRAME_MAX_LEN];
+  frameEncodeCommand(cmd.c_str(), 0, frame);
+  auto it = script.find(std::string((const char *)frame + 2, frame[1]));
+  if (it == script.end() || it->second.empty()) return false;
+  ScriptedReply r = it->second.front();
+  it->second.pop_front();
+
+  size_t n = 0;
+  frame[n++] = FRAME_HEAD | (r.packed ? FRAME_PACKED : 0) | (seq & FRAME_SEQ_MASK);
+  frame[n++] = (uint8_t)r.payload.size();
+  memcpy(frame + n, r.payload.data(), r.payload.size());
+  n += r.payload.size();
+  uint16_t crc = frameCrc16(frame, n);
+  frame[n++] = crc >> 8;
+  frame[n++] = crc & 0xFF;
+  queueReply(std::string((const char *)frame, n), start);
+  return true;
+}
+
+// When the UART would raise its RX timeout for the bytes at the front:
+// the end of that back-to-back burst plus the configured idle time
+uint64_t FakeTeensy::receiveDue() const {
+  uint64_t last = rx.front().due;
+  for (const TimedByte &b : rx) {
+    if (b.due > last + byteTimeUs(teensyBaud)) break;
+    last = b.due;
+  }
+  return last + rxTimeoutSymbols * byteTimeUs(teensyBaud);
+}
+
+// Stands in for the ESP32 UART event task
+void FakeTeensy::receiveTask() {
+  std::unique_lock<std::mutex> l(lock);
+  for (;;) {
+    if (rx.empty() || rxCallback == nullptr) {
+      rxChanged.wait(l);
+      continue;
+    }
+    uint64_t due = receiveDue();
+    uint64_t now = micros();
+    if (due > now) {
+      rxChanged.wait_for(l, std::chrono::microseconds(due - now));
+      continue;
+    }
+    OnReceiveCb cb = rxCallback;
+    l.unlock();
+    cb();
+    l.lock();
+  }
+}
+
+int FakeTeensy::availableLocked(uint64_t now) const {
+  int n = 0;
+  for (const TimedByte &b : rx) {
+    if (b.due > now) break;
+    n++;
+  }
+  return n;
+}
+
+int FakeTeensy::available() {
+  std::lock_guard<std::mutex> l(lock);
+  return availableLocked(micros());
+}
+
+int FakeTeensy::read() {
+  std::lock_guard<std::mutex> l(lock);
+  if (availableLocked(micros()) == 0) return -1;
+  char c = rx.front().c;
+  rx.pop_front();
+  return (uint8_t)c;
+}
+
+int FakeTeensy::peek() {
+  std::lock_guard<std::mutex> l(lock);
+  return availableLocked(micros()) ? (uint8_t)rx.front().c : -1;
+}
+
+void FakeTeensy::flush() {
+  // Writes are modelled as already on the wire, nothing to wait for
+}
+
+// Sent at the Teensy's rate. At a rate the bridge is not listening on
+// every byte is garbage, above maxBaud the line drops a bit now and then.
+void FakeTeensy::queueReply(const std::string &reply, uint64_t start) {
+  uint64_t t = start > txBusyUntil ? start : txBusyUntil;
+  for (size_t i = 0; i < reply.size(); i++) {
+    char c = reply[i];
+    if (teensyBaud != baudRate) c = (char)0xFF;
+    else if (teensyBaud > maxBaud && i % 7 == 3) c ^= 0x04;
+    t += byteTimeUs(teensyBaud);
+    rx.push_back({ t, c });
+  }
+  txBusyUntil = t;
+  rxChanged.notify_one();
+}
+
+// Bytes written by the bridge. Their arrival time at the Teensy is
+// modelled as back-to-back at the line rate.
+size_t FakeTeensy::write(uint8_t c) {
+  std::lock_guard<std::mutex> l(lock);
+  uint64_t now = micros();
+  cmdArrive = (cmdArrive > now ? cmdArrive : now) + byteTimeUs(baudRate);
+  checkBaudTrial(cmdArrive);
+  checkReboot(cmdArrive);
+
+  // Framing error: the LX200Handler drops back to its base rate
+  if (baudRate != teensyBaud) {
+    teensyBaud = baseBaud;
+    trialPending = false;
+    inCommand = false;
+    cmdFrame.reset();
+    return 1;
+  }
+
+  // Frames and text commands (link control) share the line
+  if (framesOn && !inCommand && (cmdFrame.inFrame() || (c & FRAME_HEAD))) {
+    FrameResult r = cmdFrame.feed(c);
+    char cmd[FRAME_MAX_PAYLOAD + 8];
+    if (r == FRAME_OK && frameDecodeCommand(cmdFrame.payload(), cmdFrame.len(), cmd, sizeof(cmd))) {
+      handleCommand(cmd, now, cmdFrame.seq());
+    }
+    return 1;
+  }
+
+  if (!inCommand) {
+    if (c == 'L' && !session) {
+      handshaken = true;
+      queueReply("K", cmdArrive + ackUs);
+    } else if (c == ':') {
+      inCommand = true;
+      cmdBuf = ":";
+    }
+    return 1;
+  }
+
+  cmdBuf += (char)c;
+  if (c == '#') {
+    inCommand = false;
+    handleCommand(cmdBuf, now);
+  }
+  return 1;
+}
+
+void FakeTeensy::handleCommand(const std::string &cmd, uint64_t now, int seq) {
+  // Old LX200Handler only listens after the 'L' handshake
+  if (!session && !handshaken) return;
+  handshaken = false;
+  commandCount++;
+
+  if (cmd == ":XS#") {
+    framesOn = false;
+    if (sessionSupported) {
+      session = true;
+      queueReply("1#", cmdArrive + delayUs);
+    } else {
+      queueReply("0", cmdArrive + delayUs);  // OnStepX: unknown command
+    }
+    return;
+  }
+
+  if (baudSupported && session && cmd.compare(0, 3, ":XB") == 0) {
+    unsigned long rate = strtoul(cmd.c_str() + 3, nullptr, 10);
+    if (rate == 0) {
+      queueReply("0", cmdArrive + delayUs);
+      return;
+    }
+    queueReply("1#", cmdArrive + delayUs);
+    trialPrevBaud = teensyBaud;
+    teensyBaud = rate;
+    trialUntil = cmdArrive + 250000;
+    trialPending = true;
+    return;
+  }
+  if (baudSupported && session && cmd.compare(0, 3, ":XE") == 0) {
+    std::string payload = cmd.substr(3, cmd.size() - 4);
+    char crc[8];
+    snprintf(crc, sizeof(crc), "%04X#", crc16(payload));
+    queueReply(payload + crc, cmdArrive + delayUs);
+    return;
+  }
+  if (baudSupported && session && cmd == ":XC#") {
+    queueReply(trialPending ? "1#" : "0", cmdArrive + delayUs);
+    trialPending = false;
+    return;
+  }
+
+  if (framesSupported && session && cmd == ":XF#") {
+    queueReply("1#", cmdArrive + delayUs);
+    framesOn = true;
+    cmdFrame.reset();
+    return;
+  }
+
+  if (dropEvery && commandCount % dropEvery == 0) return;
+  uint64_t replyAt = cmdArrive + delayUs;
+  if (slowEvery && commandCount % slowEvery == 0) replyAt += slowUs;
+  if (seq >= 0 && scriptedReply(cmd, seq, replyAt)) return;
+
+  std::string reply = replyFor(cmd, now);
+  if (reply.empty()) return;
+  if (seq >= 0) {
+    uint8_t frame[FRAME_MAX_LEN];
+    size_t n = frameEncodeReply(cmd.c_str(), reply.c_str(), seq, frame);
+    if (corruptEvery && ++frameCount % corruptEvery == 0) frame[n - 1] ^= 0x01;
+    reply.assign((const char *)frame, n);
+  }
+  queueReply(reply, replyAt);
+}
+
+// Canned OnStepX replies. RA drifts with time so caches can be observed.
+std::string FakeTeensy::replyFor(const std::string &cmd, uint64_t now) {
+  const char *ok = bareBool ? "1" : "1#";
+  char buf[32];
+  bool slewing = now < slewUntil;
+
+  if (cmd == ":GR#") {
+    unsigned long s = (unsigned long)(now / 1000000ULL) + 12 * 3600 + (slewing ? (unsigned long)((slewUntil - now) / 10000) : 0);
+    snprintf(buf, sizeof(buf), "%02lu:%02lu:%02lu#", (s / 3600) % 24, (s / 60) % 60, s % 60);
+    return buf;
+  }
+  if (cmd == ":GD#") return "+45*30:15#";
+  if (cmd == ":GA#") return "+30*12:00#";
+  if (cmd == ":GZ#") return "180*45:30#";
+  if (cmd == ":GI#") return "192.168.1.50#";
+  if (cmd == ":GW#") return slewing ? "ANT#" : "AT1#";
+  if (cmd == ":Gc#") return "24#";
+  if (cmd == ":GC#") return "05/25/25#";
+  if (cmd == ":GL#") return "21:30:00#";
+  if (cmd == ":GG#") return "+06:00#";
+  if (cmd == ":Gt#") return "+45*00#";
+  if (cmd == ":Gg#") return "+093*00#";
+  if (cmd == ":GS#") return "10:15:00#";
+  if (cmd == ":GU#") return slewing ? "nN#" : "nNT#";
+  if (cmd == ":D#")  return slewing ? "\x7f#" : "#";
+  if (cmd == ":Q#")  { slewUntil = 0; return "#"; }
+  if (cmd == ":MS#" || cmd == ":MA#") {
+    slewUntil = now + 5000000ULL;
+    return bareBool ? "0" : "0#";
+  }
+  if (cmd == ":CM#") return "N/A#";
+
+  // Motion, rate, site and sync commands return nothing
+  if (cmd.size() == 4 && (cmd[1] == 'M' || cmd[1] == 'Q' || cmd[1] == 'R')) return "";
+  if (cmd == ":W1#" || cmd == ":CS#") return "";
+
+  if (cmd.compare(0, 3, ":Sr") == 0 && atoi(cmd.c_str() + 3) > 23) return bareBool ? "0" : "0#";
+  if (cmd[1] == 'S') return ok;
+  return "0";  // OnStepX: unknown command
+}
+
+// Never destroyed: the receive thread waits on it until the process is gone
+static FakeTeensy &fakeTeensy = *new FakeTeensy();
+HardwareSerial &Serial1 = fakeTeensy;
@@ -0,0 +1,116 @@
+#ifndef FAKE_TEENSY_H
+#define FAKE_TEENSY_H
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <Arduino.h>
+#include "TeensyFrames.h"
+
+// In-process stand-in for the Teensy LX200Handler + OnStepX, wired up as
+// Serial1 on the native build. Replies are released with realistic timing:
+// wire time at the configured baud rate plus a processing delay per command.
+// A receive thread stands in for the ESP32 UART event task and calls the
+// onReceive() callback once the line goes idle, like the UART RX timeout.
+//
+// Environment variables:
+//   FAKE_TEENSY_DELAY_US   processing time per command (default 1500)
+//   FAKE_TEENSY_ACK_US     'L' -> 'K' turnaround (default 200)
+//   FAKE_TEENSY_SESSION    0 to emulate firmware without ":XS#" support
+//   FAKE_TEENSY_BARE_BOOL  1 to answer bool commands with "1" instead of "1#"
+//   FAKE_TEENSY_DROP_EVERY drop the reply to every Nth command (0 = never)
+//   FAKE_TEENSY_SLOW_EVERY reply to every Nth command FAKE_TEENSY_SLOW_US (default
+//                          100000) late (0 = never)
+//   FAKE_TEENSY_BAUD       0 to emulate firmware without ":XB#" baud negotiation
+//   FAKE_TEENSY_MAX_BAUD   replies are garbled above this rate (default 921600)
+//   FAKE_TEENSY_FRAMES     0 to emulate firmware without ":XF#" binary frames
+//   FAKE_TEENSY_CORRUPT_EVERY  flip a bit in every Nth reply frame (0 = never)
+//   FAKE_TEENSY_REBOOT_MS  reboot every this many ms: back to the base rate with
+//                          no session (0 = never)
+//   FAKE_TEENSY_SCRIPT     reply file written by tools/lx200_replay.py --teensy-script:
+//                          each command frame gets the replies captured for it, in
+//                          order, then the canned one
+class FakeTeensy : public HardwareSerial {
+  public:
+    FakeTeensy();
+
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1) override;
+    void updateBaudRate(unsigned long baud) override;
+    void onReceive(OnReceiveCb cb, bool onlyOnTimeout = false) override;
+    bool setRxTimeout(uint8_t symbols) override;
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t c) override;
+    using Print::write;
+    void flush() override;
+
+  private:
+    struct TimedByte {
+      uint64_t due;
+      char c;
+    };
+
+    struct ScriptedReply {
+      bool packed;
+      std::string payload;
+    };
+
+    void handleCommand(const std::string &cmd, uint64_t now, int seq = -1);
+    std::string replyFor(const std::string &cmd, uint64_t now);
+    void loadScript(const char *path);
+    bool scriptedReply(const std::string &cmd, int seq, uint64_t start);
+    void queueReply(const std::string &reply, uint64_t start);
+    uint64_t byteTimeUs(unsigned long baud) const;
+    void checkBaudTrial(uint64_t now);
+    void checkReboot(uint64_t now);
+    int availableLocked(uint64_t now) const;
+    uint64_t receiveDue() const;
+    void receiveTask();
+
+    std::deque<TimedByte> rx;  // bytes travelling Teensy -> bridge
+    uint64_t txBusyUntil = 0;  // Teensy TX line busy until
+    uint64_t cmdArrive = 0;    // when the last command byte reached the Teensy
+
+    unsigned long baseBaud = 115200;    // rate set by begin(), used after framing errors
+    unsigned long teensyBaud = 115200;  // the Teensy's side of the line
+    unsigned long trialPrevBaud = 0;
+    uint64_t trialUntil = 0;            // ":XB#" rate reverts unless ":XC#" arrives by then
+    bool trialPending = false;
+
+    std::string cmdBuf;
+    bool inCommand = false;
+    bool handshaken = false;
+    bool session = false;
+    bool framesOn = false;
+    FrameParser cmdFrame;
+    unsigned long frameCount = 0;
+    unsigned long commandCount = 0;
+    uint64_t slewUntil = 0;
+    OnReceiveCb rxCallback = nullptr;
+    uint8_t rxTimeoutSymbols = 2;
+    bool receiveStarted = false;
+
+    std::mutex lock;  // the receive thread and the sketch share rx
+    std::condition_variable rxChanged;
+
+    unsigned long delayUs;
+    unsigned long ackUs;
+    bool sessionSupported;
+    bool bareBool;
+    unsigned long dropEvery;
+    unsigned long slowEvery;
+    unsigned long slowUs;
+    bool baudSupported;
+    unsigned long maxBaud;
+    bool framesSupported;
+    unsigned long corruptEvery;
+    uint64_t rebootUs;
+    uint64_t rebootAt;
+    std::map<std::string, std::deque<ScriptedReply>> script;  // by command payload
+};
+
+#endif // FAKE_TEENSY_H
@@ -0,0 +1,25 @@
+#ifndef NATIVE_IPADDRESS_H
+#define NATIVE_IPADDRESS_H
+
+#include "Arduino.h"
+
+class IPAddress : public Printable {
+  public:
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { octets[0] = a; octets[1] = b; octets[2] = c; octets[3] = d; }
+    uint8_t operator[](int i) const { return octets[i]; }
+    bool operator==(const IPAddress &o) const { return memcmp(octets, o.octets, 4) == 0; }
+    size_t printTo(Print &p) const override {
+      return p.printf("%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+    }
+    String toString() const {
+      char buf[16];
+      snprintf(buf, sizeof(buf), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+      return String(buf);
+    }
+
+  private:
+    uint8_t octets[4] = { 0, 0, 0, 0 };
+};
+
+#endif // NATIVE_IPADDRESS_H
@@ -0,0 +1,277 @@
+// Host implementation of the Arduino/ESP32 calls used by the bridge
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// ---- Time ---------------------------------------------------------------
+static uint64_t nowMicros() {
+  static uint64_t start = 0;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  uint64_t us = (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+  if (start == 0) start = us;
+  return us - start;
+}
+
+unsigned long micros() { return (unsigned long)nowMicros(); }
+unsigned long millis() { return (unsigned long)(nowMicros() / 1000); }
+
+void delayMicroseconds(unsigned int us) {
+  struct timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+  nanosleep(&ts, nullptr);
+}
+
+void delay(unsigned long ms) {
+  struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000 };
+  nanosleep(&ts, nullptr);
+}
+
+void yield() {}
+
+// ---- Task notification --------------------------------------------------
+static std::mutex notifyLock;
+static std::condition_variable notifyCond;
+static uint32_t notifyValue = 0;
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return &notifyValue;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  (void)task;
+  {
+    std::lock_guard<std::mutex> lock(notifyLock);
+    notifyValue++;
+  }
+  notifyCond.notify_one();
+  return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait) {
+  std::unique_lock<std::mutex> lock(notifyLock);
+  notifyCond.wait_for(lock, std::chrono::milliseconds(ticksToWait), [] { return notifyValue != 0; });
+  uint32_t v = notifyValue;
+  if (v != 0) notifyValue = clearOnExit ? 0 : v - 1;
+  return v;
+}
+
+// ---- GPIO / system ------------------------------------------------------
+void pinMode(uint8_t pin, uint8_t mode) { (void)pin; (void)mode; }
+int digitalRead(uint8_t pin) { (void)pin; return HIGH; }  // reset pin never asserted
+
+void esp_restart() {
+  fflush(stdout);
+  exit(0);
+}
+
+#if !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size) {
+  size_t len = strlen(src);
+  if (size) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+#endif
+
+// ---- String / Print -----------------------------------------------------
+void String::trim() {
+  size_t b = s.find_first_not_of(" \t\r\n");
+  size_t e = s.find_last_not_of(" \t\r\n");
+  s = (b == std::string::npos) ? std::string() : s.substr(b, e - b + 1);
+}
+
+size_t Print::write(const uint8_t *buf, size_t n) {
+  for (size_t i = 0; i < n; i++) write(buf[i]);
+  return n;
+}
+
+size_t Print::printf(const char *fmt, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  if (n < 0) return 0;
+  return write((const uint8_t *)buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+}
+
+size_t Stream::readBytes(uint8_t *buf, size_t n) {
+  size_t i = 0;
+  while (i < n && available() > 0) buf[i++] = (uint8_t)read();
+  return i;
+}
+
+// Debug serial goes to stdout unless LX200_QUIET is set (e.g. for benchmarks)
+size_t HardwareSerial::write(uint8_t c) {
+  static int quiet = -1;
+  if (quiet < 0) quiet = getenv("LX200_QUIET") != nullptr;
+  if (!quiet) fputc(c, stdout);
+  return 1;
+}
+
+// Console keys ('s', 'c') are read from stdin without blocking
+class DebugSerial : public HardwareSerial {
+  public:
+    int available() override {
+      struct pollfd p = { STDIN_FILENO, POLLIN, 0 };
+      if (pending < 0 && poll(&p, 1, 0) == 1) {
+        char c;
+        if (::read(STDIN_FILENO, &c, 1) == 1) pending = (uint8_t)c;
+      }
+      return pending >= 0;
+    }
+    int read() override {
+      if (!available()) return -1;
+      int c = pending;
+      pending = -1;
+      return c;
+    }
+
+  private:
+    int pending = -1;
+};
+
+static DebugSerial debugSerial;
+HardwareSerial &Serial = debugSerial;
+
+WiFiClass WiFi;
+
+// ---- WiFiClient ---------------------------------------------------------
+WiFiClient::WiFiClient(int fd) : sock(std::make_shared<int>(fd)) {}
+
+int WiFiClient::available() {
+  if (!sock || *sock < 0) return 0;
+  int n = 0;
+  if (ioctl(*sock, FIONREAD, &n) < 0) return 0;
+  return n;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t *buf, size_t size) {
+  if (!sock || *sock < 0) return -1;
+  ssize_t n = recv(*sock, buf, size, MSG_DONTWAIT);
+  return n < 0 ? -1 : (int)n;
+}
+
+size_t WiFiClient::write(const uint8_t *buf, size_t size) {
+  if (!sock || *sock < 0) return 0;
+  ssize_t n = send(*sock, buf, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+  return n < 0 ? 0 : (size_t)n;
+}
+
+uint8_t WiFiClient::connected() {
+  if (!sock || *sock < 0) return 0;
+  uint8_t c;
+  ssize_t n = recv(*sock, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    stop();
+    return 0;
+  }
+  return 1;
+}
+
+void WiFiClient::stop() {
+  if (sock && *sock >= 0) {
+    close(*sock);
+    *sock = -1;
+  }
+}
+
+int WiFiClient::setNoDelay(bool nodelay) {
+  if (!sock || *sock < 0) return -1;
+  int v = nodelay ? 1 : 0;
+  return setsockopt(*sock, IPPROTO_TCP, TCP_NODELAY, &v, sizeof(v));
+}
+
+// ---- WiFiServer ---------------------------------------------------------
+void WiFiServer::begin() {
+  listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFd, 8) < 0) {
+    perror("WiFiServer");
+    exit(1);
+  }
+  fcntl(listenFd, F_SETFL, O_NONBLOCK);
+}
+
+bool WiFiServer::hasClient() {
+  if (pendingFd < 0 && listenFd >= 0) pendingFd = ::accept(listenFd, nullptr, nullptr);
+  return pendingFd >= 0;
+}
+
+WiFiClient WiFiServer::accept() {
+  if (!hasClient()) return WiFiClient();
+  int fd = pendingFd;
+  pendingFd = -1;
+  return WiFiClient(fd);
+}
+
+// ---- WiFiUDP ------------------------------------------------------------
+// Send only, the bridge never listens on UDP so the port is not bound
+uint8_t WiFiUDP::begin(uint16_t port) {
+  (void)port;
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+  return fd >= 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port) {
+  if (fd < 0) begin(0);
+  destAddr = htonl(((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) | ((uint32_t)ip[2] << 8) | ip[3]);
+  destPort = port;
+  packetLen = 0;
+  return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t *buf, size_t size) {
+  if (packetLen + size > sizeof(packet)) size = sizeof(packet) - packetLen;
+  memcpy(packet + packetLen, buf, size);
+  packetLen += size;
+  return size;
+}
+
+int WiFiUDP::endPacket() {
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = destAddr;
+  addr.sin_port = htons(destPort);
+  ssize_t n = sendto(fd, packet, packetLen, 0, (struct sockaddr *)&addr, sizeof(addr));
+  packetLen = 0;
+  return n >= 0;
+}
+
+void WiFiUDP::stop() {
+  if (fd >= 0) close(fd);
+  fd = -1;
+}
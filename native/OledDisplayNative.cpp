@@ -0,0 +1,12 @@
+// OLED stand-in for the host-native build, prints to the debug console
+
+#include "OledDisplay.h"
+
+bool initOledDisplay() { return true; }
+
+void updateOledDisplay(IPAddress lxStaIpMsg, IPAddress lxApIpMsg, String wdStaIpMsg, IPAddress wdApIpMsg) {
+  Serial.print("OLED LX-STA:"); Serial.println(lxStaIpMsg);
+  Serial.print("OLED LX-AP :"); Serial.println(lxApIpMsg);
+  Serial.print("OLED WD-STA:"); Serial.println(wdStaIpMsg);
+  Serial.print("OLED WD-AP :"); Serial.println(wdApIpMsg);
+}
@@ -0,0 +1,36 @@
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "WiFiClient.h"
+#include "WiFiServer.h"
+
+typedef enum { WL_IDLE_STATUS = 0, WL_CONNECTED = 3, WL_DISCONNECTED = 6 } wl_status_t;
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+typedef enum { WIFI_POWER_19_5dBm = 78 } wifi_power_t;
+
+// The host is always "connected", both interfaces report the loopback address
+class WiFiClass {
+  public:
+    bool mode(wifi_mode_t m) { (void)m; return true; }
+    wl_status_t begin(const char *ssid, const char *pass) { (void)ssid; (void)pass; return WL_CONNECTED; }
+    wl_status_t status() { return WL_CONNECTED; }
+    IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+    IPAddress broadcastIP() { return IPAddress(127, 255, 255, 255); }
+    bool setSleep(bool enable) { (void)enable; return true; }
+    bool setAutoReconnect(bool enable) { (void)enable; return true; }
+    bool softAPConfig(IPAddress ip, IPAddress gw, IPAddress mask) { (void)ip; (void)gw; (void)mask; return true; }
+    bool softAP(const char *ssid, const char *pass = nullptr, int channel = 1, int hidden = 0, int maxConn = 4) {
+      (void)ssid; (void)pass; (void)channel; (void)hidden; (void)maxConn; return true;
+    }
+    IPAddress softAPIP() { return IPAddress(127, 0, 0, 1); }
+    IPAddress softAPBroadcastIP() { return IPAddress(127, 255, 255, 255); }
+    uint8_t softAPgetStationNum() { return 0; }
+    int8_t RSSI() { return 0; }
+    bool setTxPower(wifi_power_t power) { (void)power; return true; }
+};
+
+extern WiFiClass WiFi;
+
+#endif // NATIVE_WIFI_H
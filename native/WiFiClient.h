@@ -0,0 +1,31 @@
+#ifndef NATIVE_WIFICLIENT_H
+#define NATIVE_WIFICLIENT_H
+
+#include <memory>
+#include "Arduino.h"
+#include "IPAddress.h"
+
+// TCP client on a POSIX socket. Copies share the socket, like the ESP32 core.
+class WiFiClient : public Stream {
+  public:
+    WiFiClient() {}
+    explicit WiFiClient(int fd);
+
+    int available() override;
+    int read() override;
+    int read(uint8_t *buf, size_t size);
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t size) override;
+    using Print::write;
+
+    uint8_t connected();
+    void stop();
+    int setNoDelay(bool nodelay);
+    int fd() const { return sock ? *sock : -1; }
+    operator bool() const { return sock && *sock >= 0; }
+
+  private:
+    std::shared_ptr<int> sock;
+};
+
+#endif // NATIVE_WIFICLIENT_H
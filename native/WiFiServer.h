@@ -0,0 +1,21 @@
+#ifndef NATIVE_WIFISERVER_H
+#define NATIVE_WIFISERVER_H
+
+#include "WiFiClient.h"
+
+class WiFiServer {
+  public:
+    explicit WiFiServer(uint16_t port) : port(port) {}
+    void begin();
+    WiFiClient available() { return accept(); }
+    WiFiClient accept();
+    bool hasClient();
+    void setNoDelay(bool nodelay) { (void)nodelay; }
+
+  private:
+    uint16_t port;
+    int listenFd = -1;
+    int pendingFd = -1;
+};
+
+#endif // NATIVE_WIFISERVER_H
@@ -0,0 +1,26 @@
+#ifndef NATIVE_WIFIUDP_H
+#define NATIVE_WIFIUDP_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+// Datagram sender on a POSIX socket, broadcasts allowed
+class WiFiUDP : public Print {
+  public:
+    uint8_t begin(uint16_t port);
+    int beginPacket(IPAddress ip, uint16_t port);
+    int endPacket();
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t size) override;
+    using Print::write;
+    void stop();
+
+  private:
+    int fd = -1;
+    uint32_t destAddr = 0;
+    uint16_t destPort = 0;
+    uint8_t packet[512];
+    size_t packetLen = 0;
+};
+
+#endif // NATIVE_WIFIUDP_H
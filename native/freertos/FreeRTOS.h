@@ -0,0 +1,15 @@
+// Minimal FreeRTOS types for the host-native build
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))  // 1 kHz tick like the ESP32
+
+#endif // FREERTOS_H
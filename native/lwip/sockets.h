@@ -0,0 +1,8 @@
+// lwIP's BSD socket API maps straight onto the host's
+#ifndef LWIP_SOCKETS_H
+#define LWIP_SOCKETS_H
+
+#include <errno.h>
+#include <sys/socket.h>
+
+#endif // LWIP_SOCKETS_H
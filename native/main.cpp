@@ -0,0 +1,17 @@
+// Entry point for the host-native build: run the sketch forever. Unit
+// tests bring their own (see test/).
+
+#include <Arduino.h>
+#include <signal.h>
+
+#ifndef PIO_UNIT_TESTING
+void setup();
+void loop();
+
+int main() {
+  signal(SIGPIPE, SIG_IGN);
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  setup();
+  for (;;) loop();
+}
+#endif
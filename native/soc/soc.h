@@ -0,0 +1,2 @@
+#pragma once
+// Empty on the native build
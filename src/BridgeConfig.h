@@ -0,0 +1,69 @@
+#ifndef BRIDGE_CONFIG_H
+#define BRIDGE_CONFIG_H
+
+// Shared hardware and link settings for the LX200 WiFi Bridge
+
+#define SERIAL_TEENSY Serial1
+#define SERIAL_DEBUG Serial
+
+#define TEENSY_ACK_TIMEOUT 500
+
+// Learn reply timeouts per command from observed Teensy latency (see
+// LinkTimeouts.h). Set to 0 for the fixed 2300/450 ms windows.
+#define TEENSY_ADAPTIVE_TIMEOUTS   1
+
+// Session mode: handshake with the Teensy LX200Handler once and then stream
+// commands without the per-command 'L'/'K' exchange. Set to 0 to always use
+// the per-command handshake (older DDScopeX firmware falls back automatically).
+#define TEENSY_SESSION_MODE        1
+#define TEENSY_SESSION_RETRY_MS    30000  // how often to retry a session request that got no answer
+
+// Baud negotiation: once a session is open, step the Teensy UART up through
+// the rates in TeensyLink.cpp for as long as probe bursts echo back intact.
+// The link starts at, and falls back to, TEENSY_BAUD_BASE.
+#define TEENSY_BAUD_BASE           230400
+#define TEENSY_BAUD_NEGOTIATE      1
+
+// Binary frames: once the session is open and the baud rate settled, move
+// commands and replies to CRC-16 checked binary frames (see TeensyFrames.h).
+// Firmware without them stays on LX200 text.
+#define TEENSY_FRAMES              1
+
+// Response cache: how long a position/status reply from the Teensy may be
+// reused for other polls. Set to 0 to disable caching of those.
+#define CACHE_POSITION_TTL_MS      100
+
+// Telemetry prefetch: while a client is connected the bridge polls position
+// and slew status itself, fast while the mount moves and slow while it only
+// tracks, so client polls are answered from the cache (see TelemetryPrefetch.h).
+#define PREFETCH_ENABLE            1
+#define PREFETCH_MOTION_MS         100   // poll period while slewing or moving
+#define PREFETCH_TRACKING_MS       1000  // poll period otherwise
+#define PREFETCH_MOTION_HOLD_MS    2000  // keep polling fast after motion stops
+
+// Stellarium Telescope Control clients on STELLARIUM_PORT get the position
+// pushed at this period (see StellariumServer.h)
+#define STELLARIUM_PUSH_MS         500
+
+// Period of the position datagram on BROADCAST_PORT (see
+// PositionBroadcast.h), e.g. 500. Off by default: while it is on the
+// prefetcher keeps polling the Teensy whenever a station is on the AP or
+// the home network is joined, whether or not anybody listens.
+#define POSITION_BROADCAST_MS      0
+
+// Set command batching: target and site sets are acknowledged by the bridge
+// and sent to the Teensy together ahead of the client's next command, or
+// on their own after LX200_BATCH_HOLD_MS (see LX200Batch in LX200Commands.h).
+#define LX200_BATCH_SETS           1
+#define LX200_BATCH_HOLD_MS        50
+
+// Session capture of client and Teensy traffic for replay on the native
+// build (see SessionCapture.h). 0 compiles it out.
+#define BRIDGE_CAPTURE             1
+#define CAPTURE_BUF_BYTES          16384  // power of two
+
+// Debug trace of the hot path (see BridgeTrace.h)
+//   0 = compiled out, 1 = errors and link events, 2 = also every command
+#define BRIDGE_TRACE_LEVEL         2
+
+#endif // BRIDGE_CONFIG_H
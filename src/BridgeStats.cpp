@@ -0,0 +1,129 @@
+#include "BridgeStats.h"
+
+#define SUB_BITS     2                     // 4 sub-buckets per power of two
+#define SUB_BUCKETS  (1 << SUB_BITS)
+#define MAX_BITS     24                    // up to ~16.7 s
+#define BUCKETS      ((MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS)
+#define OTHER_SLOT   STATS_OPCODES
+
+struct Histogram {
+  uint32_t count[BUCKETS];
+  uint32_t total;
+  uint32_t max;
+};
+
+struct OpStats {
+  uint32_t opKey;  // 0 = unused
+  Histogram stage[STAT_STAGES];
+};
+
+static OpStats ops[STATS_OPCODES + 1];  // last slot collects everything else
+
+static const char *const stageNames[STAT_STAGES] = { "total", "link", "uart", "send" };
+
+// Values below 2^SUB_BITS get a bucket each, above that every power of
+// two is split into SUB_BUCKETS equal parts.
+static uint8_t bucketFor(uint32_t us) {
+  if (us >= (1UL << MAX_BITS)) return BUCKETS - 1;
+  if (us < SUB_BUCKETS) return us;
+  uint8_t octave = 31 - __builtin_clz(us);
+  uint8_t sub = (us >> (octave - SUB_BITS)) & (SUB_BUCKETS - 1);
+  return (octave - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+// Largest value that falls in bucket b
+static uint32_t bucketUpper(uint8_t b) {
+  if (b < SUB_BUCKETS) return b;
+  uint8_t octave = b / SUB_BUCKETS + SUB_BITS - 1;
+  uint8_t sub = b % SUB_BUCKETS;
+  return (((uint32_t)(SUB_BUCKETS + sub + 1)) << (octave - SUB_BITS)) - 1;
+}
+
+static OpStats *slotFor(uint32_t opKey, bool create) {
+  for (uint8_t i = 0; i < STATS_OPCODES; i++) {
+    if (ops[i].opKey == opKey) return &ops[i];
+    if (ops[i].opKey == 0) {
+      if (!create) return nullptr;
+      ops[i].opKey = opKey;
+      return &ops[i];
+    }
+  }
+  return create ? &ops[OTHER_SLOT] : nullptr;
+}
+
+static void opName(uint32_t opKey, char *buf) {
+  if (opKey == 0 || opKey == STATS_KEY_URGENT) {
+    strcpy(buf, opKey == 0 ? "other" : "urgent");
+    return;
+  }
+  for (uint8_t i = 0; i < 3; i++) buf[i] = (char)(opKey >> (8 * i));
+  buf[3] = '\0';
+}
+
+static uint32_t histPercentile(const Histogram &h, uint8_t pct) {
+  if (h.total == 0) return 0;
+  uint32_t rank = ((uint64_t)h.total * pct + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t b = 0; b < BUCKETS; b++) {
+    seen += h.count[b];
+    if (seen >= rank) {
+      uint32_t v = bucketUpper(b);
+      return v < h.max ? v : h.max;
+    }
+  }
+  return h.max;
+}
+
+void statsRecord(uint32_t opKey, StatStage stage, uint32_t us) {
+  OpStats *s = slotFor(opKey, true);
+  Histogram &h = s->stage[stage];
+  h.count[bucketFor(us)]++;
+  h.total++;
+  if (us > h.max) h.max = us;
+}
+
+uint32_t statsPercentile(uint32_t opKey, StatStage stage, uint8_t pct) {
+  OpStats *s = slotFor(opKey, false);
+  return s == nullptr ? 0 : histPercentile(s->stage[stage], pct);
+}
+
+// Compact reply for ":XH#": "GR:n,p50,p99,max;GD:...#", total stage in us.
+// Written into out, opcodes that don't fit in cap are left off. Returns
+// the length.
+size_t statsSummary(char *out, size_t cap) {
+  if (cap == 0) return 0;
+  size_t len = 0;
+  char name[8];
+  for (uint8_t i = 0; i <= STATS_OPCODES; i++) {
+    const Histogram &h = ops[i].stage[STAT_TOTAL];
+    if (h.total == 0) continue;
+    opName(i == OTHER_SLOT ? 0 : ops[i].opKey, name);
+    int n = snprintf(out + len, cap - len, "%s:%lu,%lu,%lu,%lu;", name, (unsigned long)h.total,
+                     (unsigned long)histPercentile(h, 50), (unsigned long)histPercentile(h, 99), (unsigned long)h.max);
+    if (n < 0 || len + n >= cap - 1) break;  // leave room for the '#'
+    len += n;
+  }
+  out[len++] = '#';
+  return len;
+}
+
+// Full table for the debug serial
+void statsPrint(Print &out) {
+  char name[8];
+  out.println("[STATS] op     stage        n     p50us     p90us     p99us     maxus");
+  for (uint8_t i = 0; i <= STATS_OPCODES; i++) {
+    if (ops[i].stage[STAT_TOTAL].total == 0) continue;
+    opName(i == OTHER_SLOT ? 0 : ops[i].opKey, name);
+    for (uint8_t st = 0; st < STAT_STAGES; st++) {
+      const Histogram &h = ops[i].stage[st];
+      if (h.total == 0) continue;
+      out.printf("[STATS] %-6s %-6s %8lu %9lu %9lu %9lu %9lu\n", name, stageNames[st], (unsigned long)h.total,
+                 (unsigned long)histPercentile(h, 50), (unsigned long)histPercentile(h, 90),
+                 (unsigned long)histPercentile(h, 99), (unsigned long)h.max);
+    }
+  }
+}
+
+void statsReset() {
+  memset(ops, 0, sizeof(ops));
+}
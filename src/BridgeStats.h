@@ -0,0 +1,38 @@
+#ifndef BRIDGE_STATS_H
+#define BRIDGE_STATS_H
+
+#include <Arduino.h>
+
+// Per-opcode latency histograms for bridged commands.
+//
+// Each command is timed in micros() through four stages:
+//   total  client command framed -> reply written to the client
+//   link   queued on the Teensy link -> reply complete
+//   uart   written to the UART -> reply complete
+//   send   client command framed -> written to the UART
+// so link - uart is time spent queued or handshaking, and total - link is
+// the bridge's own overhead. Stops and manual moves are also collected
+// under STATS_KEY_URGENT ("urgent"), whose send max is the worst-case
+// stop latency. Histograms are log-linear (4 buckets per power of two)
+// in fixed memory.
+//
+// Query with the private ":XH#" command or type 's' on the debug serial.
+
+#define STATS_OPCODES 12  // opcodes tracked separately, the rest share one slot
+#define STATS_KEY_URGENT 0xFFFFFFFF  // every priority lane command
+
+enum StatStage : uint8_t {
+  STAT_TOTAL,
+  STAT_LINK,
+  STAT_UART,
+  STAT_SEND,
+  STAT_STAGES
+};
+
+void statsRecord(uint32_t opKey, StatStage stage, uint32_t us);
+uint32_t statsPercentile(uint32_t opKey, StatStage stage, uint8_t pct);
+size_t statsSummary(char *out, size_t cap);
+void statsPrint(Print &out);
+void statsReset();
+
+#endif // BRIDGE_STATS_H
@@ -0,0 +1,75 @@
+#include <atomic>
+#include "BridgeTrace.h"
+
+// Single producer (the bridge loop) and single consumer (the drain), so
+// head and tail only need ordered loads and stores, no lock.
+static TraceRecord ring[TRACE_RING_LEN];
+static std::atomic<uint16_t> head(0);  // next slot to write
+static std::atomic<uint16_t> tail(0);  // next slot to read
+static std::atomic<uint32_t> dropped(0);
+
+static const char *const eventNames[] = {
+  "CmdFromClient", "NoResponse", "Sent 'A'", "Timeout waiting for response ':'",
+  "Timeout waiting for Teensy response '#'", "Teensy session lost",
+  "Teensy frame failed CRC", "Preempted for a stop"
+};
+
+void traceRecord(TraceEvent event, uint32_t opKey, uint8_t client, uint8_t len,
+                 uint32_t totalUs, uint32_t linkUs, uint32_t uartUs) {
+  uint16_t h = head.load(std::memory_order_relaxed);
+  if ((uint16_t)(h - tail.load(std::memory_order_acquire)) >= TRACE_RING_LEN) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  TraceRecord &r = ring[h % TRACE_RING_LEN];
+  r.time = micros();
+  r.opKey = opKey;
+  r.totalUs = totalUs;
+  r.linkUs = linkUs;
+  r.uartUs = uartUs;
+  r.event = event;
+  r.client = client;
+  r.len = len;
+  head.store(h + 1, std::memory_order_release);
+}
+
+// Format up to maxRecords trace records. Returns true if any were written.
+bool traceDrain(Print &out, uint8_t maxRecords) {
+  uint32_t lost = dropped.exchange(0, std::memory_order_relaxed);
+  if (lost != 0) out.printf("[TRACE] %lu records dropped\n", (unsigned long)lost);
+
+  uint8_t n = 0;
+  while (n < maxRecords) {
+    uint16_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) break;
+
+    TraceRecord r = ring[t % TRACE_RING_LEN];
+    tail.store(t + 1, std::memory_order_release);
+    n++;
+
+    char op[4];
+    for (uint8_t i = 0; i < 3; i++) op[i] = (char)(r.opKey >> (8 * i));
+    op[3] = '\0';
+
+    switch (r.event) {
+      case TRACE_CMD:
+        out.printf("[%10lu] %s: %-3s client %u  len %u  total %luus  link %luus  uart %luus\n",
+                   (unsigned long)r.time, eventNames[r.event], op, r.client, r.len,
+                   (unsigned long)r.totalUs, (unsigned long)r.linkUs, (unsigned long)r.uartUs);
+        break;
+      case TRACE_NO_RESPONSE:
+        out.printf("[%10lu] %s: %-3s client %u  total %luus\n",
+                   (unsigned long)r.time, eventNames[r.event], op, r.client, (unsigned long)r.totalUs);
+        break;
+      case TRACE_ACK:
+        out.printf("[%10lu] %s client %u\n", (unsigned long)r.time, eventNames[r.event], r.client);
+        break;
+      default:
+        if (r.opKey != 0) out.printf("[%10lu] %s: %s\n", (unsigned long)r.time, eventNames[r.event], op);
+        else out.printf("[%10lu] %s\n", (unsigned long)r.time, eventNames[r.event]);
+        break;
+    }
+  }
+  return n > 0 || lost != 0;
+}
@@ -0,0 +1,54 @@
+#ifndef BRIDGE_TRACE_H
+#define BRIDGE_TRACE_H
+
+#include <Arduino.h>
+#include "BridgeConfig.h"
+
+// Binary trace of the hot path. Recording a trace event only copies a few
+// words into a ring buffer, no formatting and no serial I/O. The ring is
+// drained and formatted to the debug serial from loop() when the bridge
+// is idle and the serial TX buffer has room, so a slow console never
+// stalls a client. Set BRIDGE_TRACE_LEVEL in BridgeConfig.h to compile
+// trace points out.
+
+#define TRACE_RING_LEN 128  // power of two
+
+enum TraceEvent : uint8_t {
+  TRACE_CMD,            // reply sent to a client: len, total/link/uart us
+  TRACE_NO_RESPONSE,    // command that gets no reply (e.g. :Me#)
+  TRACE_ACK,            // 0x06 answered with 'A'
+  TRACE_TIMEOUT_FIRST,  // no reply byte from the Teensy
+  TRACE_TIMEOUT_TERM,   // reply from the Teensy missing its '#'
+  TRACE_SESSION_LOST,   // session dropped, handshake again
+  TRACE_FRAME_BAD,      // Teensy reply frame failed its CRC
+  TRACE_PREEMPTED       // poll put back so a stop could go first
+};
+
+struct TraceRecord {
+  uint32_t time;     // micros()
+  uint32_t opKey;    // packed opcode, see lx200OpKey()
+  uint32_t totalUs;
+  uint32_t linkUs;
+  uint32_t uartUs;
+  uint8_t event;
+  uint8_t client;
+  uint8_t len;       // reply length
+};
+
+void traceRecord(TraceEvent event, uint32_t opKey, uint8_t client = 0, uint8_t len = 0,
+                 uint32_t totalUs = 0, uint32_t linkUs = 0, uint32_t uartUs = 0);
+bool traceDrain(Print &out, uint8_t maxRecords);
+
+#if BRIDGE_TRACE_LEVEL >= 1
+#define TRACE_EVENT(event, opKey) traceRecord(event, opKey)
+#else
+#define TRACE_EVENT(event, opKey) do {} while (0)
+#endif
+
+#if BRIDGE_TRACE_LEVEL >= 2
+#define TRACE_COMMAND(event, ...) traceRecord(event, __VA_ARGS__)
+#else
+#define TRACE_COMMAND(event, ...) do {} while (0)
+#endif
+
+#endif // BRIDGE_TRACE_H
@@ -0,0 +1,214 @@
+#include "LX200Commands.h"
+#include "LX200Framer.h"
+
+#define NONE    LX200_REPLY_NONE
+#define BOOL    LX200_REPLY_BOOL
+#define STRING  LX200_REPLY_STRING
+
+#define POS     LX200_CACHE_POSITION
+#define SETTING LX200_CACHE_SETTING
+#define NOCACHE LX200_CACHE_NONE
+
+// Plain forwarded command, no quirks
+#define CMD(op, reply, cache, inval) \
+  { lx200OpKey(op), reply, lx200ShapeFor(reply), nullptr, LX200_REWRITE_NONE, nullptr, cache, inval, LX200_MOTION_NONE, LX200_QUERY_NONE, LX200_BATCH_NONE }
+
+// Answered by the bridge, never sent to the Teensy
+#define LOCAL(op, localReply) \
+  { lx200OpKey(op), STRING, LX200_SHAPE_NONE, localReply, LX200_REWRITE_NONE, nullptr, NOCACHE, false, LX200_MOTION_NONE, LX200_QUERY_NONE, LX200_BATCH_NONE }
+
+// Query about the bridge itself
+#define QUERY(op, query) \
+  { lx200OpKey(op), STRING, LX200_SHAPE_NONE, nullptr, LX200_REWRITE_NONE, nullptr, NOCACHE, false, LX200_MOTION_NONE, query, LX200_BATCH_NONE }
+
+// Command that moves the mount
+#define MOVE(op, reply, motion) \
+  { lx200OpKey(op), reply, lx200ShapeFor(reply), nullptr, LX200_REWRITE_NONE, nullptr, NOCACHE, true, motion, LX200_QUERY_NONE, LX200_BATCH_NONE }
+
+// Set command held and sent with the next one, see LX200Batch
+#define SET(op) \
+  { lx200OpKey(op), BOOL, LX200_SHAPE_CHAR, nullptr, LX200_REWRITE_NONE, nullptr, NOCACHE, true, LX200_MOTION_NONE, LX200_QUERY_NONE, LX200_BATCH_HOLD }
+
+// ============== Command Table ===========================
+static constexpr LX200CmdDesc cmdTable[] = {
+  // ---- Commands that are Specific to this App ----
+  LOCAL("GVP", "On-Step#"),   //"OnStepX.DDScopeX#"; // Product Name
+  LOCAL("GVN", "2.0#"),       // Firmware Version
+  LOCAL("GVD", "May 2025#"),  // Firmware Date
+  LOCAL("GVT", "08:02:00#"),  // Telescope Firmware time
+  //LOCAL("D",  "#"),             // Requests a string of bars indicating the distance to the current target location
+  //LOCAL("CM", "Syncd Object#"),
+  //LOCAL("GW", "AN1#"),          // Get Scope alignment status <mount><tracking><alignment>
+                                  //   mount: A-AzEl mounted, P-Equatorially mounted, G-german mounted equatorial
+                                  //   tracking: T-tracking, N-not tracking
+                                  //   alignment: 0-needs alignment, 1-one star aligned, 2-two star aligned, 3-three star aligned
+  QUERY("XH", LX200_QUERY_STATS),     // Bridge latency histograms
+  // The bridge's own link control (see TeensyLink.cpp). A client sending
+  // these would change the shared link behind the bridge's back, so they
+  // are refused like any command OnStepX doesn't know.
+  LOCAL("XS", "0"),                   // Session
+  LOCAL("XB", "0"),                   // Baud trial
+  LOCAL("XE", "0"),                   // Baud probe echo
+  LOCAL("XC", "0"),                   // Baud commit
+  LOCAL("XF", "0"),                   // Binary frames
+
+  // ---- Position and status ----
+  CMD("GR", STRING, POS, false),      // RA
+  CMD("GD", STRING, POS, false),      // Dec
+  CMD("GA", STRING, POS, false),      // Altitude
+  CMD("GZ", STRING, POS, false),      // Azimuth
+  CMD("GW", STRING, POS, false),      // Mount/tracking/alignment status
+  CMD("GU", STRING, POS, false),      // OnStep status
+  CMD("D",  STRING, POS, false),      // Distance bars, '#' alone when not slewing
+  CMD("GI", STRING, NOCACHE, false),  // IP address of the WiFi Display (DDScopeX)
+
+  // ---- Site, date and time ----
+  CMD("Gt", STRING, SETTING, false),  // Latitude
+  CMD("Gg", STRING, SETTING, false),  // Longitude
+  CMD("GG", STRING, SETTING, false),  // UTC offset
+  CMD("Gc", STRING, SETTING, false),  // 12/24 hour format
+  CMD("GM", STRING, SETTING, false),  // Site name
+  CMD("GC", STRING, NOCACHE, false),  // Local date
+  CMD("GL", STRING, NOCACHE, false),  // Local time
+  CMD("GS", STRING, NOCACHE, false),  // Sidereal time
+  CMD("GT", STRING, NOCACHE, false),  // Tracking rate
+
+  // ---- Set commands, OnStepX replies 1 or 0 ----
+  SET("Sr"),                          // Target RA
+  SET("Sd"),                          // Target Dec
+  SET("Sa"),                          // Target altitude
+  SET("Sz"),                          // Target azimuth
+  SET("St"),                          // Latitude
+  SET("Sg"),                          // Longitude
+  SET("SL"),                          // Local time
+  SET("SS"),                          // Sidereal time
+  // SkySafari is sending an unsupported format for timezone in OnStep so truncate the decimal
+  { lx200OpKey("SG"), BOOL, LX200_SHAPE_CHAR, nullptr, LX200_REWRITE_TZ_DECIMAL, nullptr, NOCACHE, true, LX200_MOTION_NONE, LX200_QUERY_NONE, LX200_BATCH_HOLD },
+  // Stellarium wants this string and not the OnStep reply of "1#"
+  // So the :SC command was sent to OnStep but here we return this string instead.
+  { lx200OpKey("SC"), BOOL, LX200_SHAPE_CHAR, nullptr, LX200_REWRITE_NONE, "1Updating Planetary Data#          #", NOCACHE, true, LX200_MOTION_NONE, LX200_QUERY_NONE, LX200_BATCH_HOLD },
+
+  // ---- Goto, sync and motion ----
+  // :MS#   returns:
+  //              0=Goto is possible
+  //              1=below the horizon limit
+  //              2=above overhead limit
+  //              3=controller in standby
+  //              4=mount is parked
+  //              5=Goto in progress
+  //              6=outside limits (AXIS2_LIMIT_MAX, AXIS2_LIMIT_MIN, AXIS1_LIMIT_MIN/MAX, MERIDIAN_E/W)
+  //              7=hardware fault
+  //              8=already in motion
+  //              9=unspecified error
+  // A single digit, passed on to the client as is
+  { lx200OpKey("MS"), STRING, LX200_SHAPE_CHAR, nullptr, LX200_REWRITE_NONE, nullptr, NOCACHE, true, LX200_MOTION_START, LX200_QUERY_NONE, LX200_BATCH_COMMIT },
+  // Goto the target Alt/Az, same reply as :MS#
+  { lx200OpKey("MA"), STRING, LX200_SHAPE_CHAR, nullptr, LX200_REWRITE_NONE, nullptr, NOCACHE, true, LX200_MOTION_START, LX200_QUERY_NONE, LX200_BATCH_COMMIT },
+  // Sync to target
+  { lx200OpKey("CM"), STRING, LX200_SHAPE_TERMINATED, nullptr, LX200_REWRITE_NONE, nullptr, NOCACHE, true, LX200_MOTION_NONE, LX200_QUERY_NONE, LX200_BATCH_COMMIT },
+  CMD("CS", NONE, NOCACHE, true),     // Synchronize the telescope with current RA/DEC
+  MOVE("Me", NONE, LX200_MOTION_MOVE),    // Start moving East
+  MOVE("Mn", NONE, LX200_MOTION_MOVE),    // Start moving North
+  MOVE("Ms", NONE, LX200_MOTION_MOVE),    // Start moving South
+  MOVE("Mw", NONE, LX200_MOTION_MOVE),    // Start moving West
+  // You MUST return a '1' ('#' get's stripped later) for Stellarium GOTO
+  // OnStepX returns nothing, just a '#'.
+  { lx200OpKey("Q"), STRING, LX200_SHAPE_TERMINATED, nullptr, LX200_REWRITE_NONE, "1", NOCACHE, true, LX200_MOTION_STOP, LX200_QUERY_NONE, LX200_BATCH_NONE },
+  MOVE("Qe", NONE, LX200_MOTION_STOP),    // Abort slew East
+  MOVE("Qn", NONE, LX200_MOTION_STOP),    // Abort slew North
+  MOVE("Qs", NONE, LX200_MOTION_STOP),    // Abort slew South
+  MOVE("Qw", NONE, LX200_MOTION_STOP),    // Abort slew West
+
+  // ---- Slew rate and site ----
+  CMD("RC", NONE, NOCACHE, false),    // Set slew rate to centering
+  CMD("RF", NONE, NOCACHE, false),    // Set slew rate to fast
+  CMD("RG", NONE, NOCACHE, false),    // Set slew rate to guiding
+  CMD("RM", NONE, NOCACHE, false),    // Set slew rate to find
+  CMD("RS", NONE, NOCACHE, false),    // Set slew rate to max, or Sync for LX200 classic
+  CMD("W1", NONE, NOCACHE, true),     // Set site 1
+
+  // ---- Tracking, park and home ----
+  CMD("Te", BOOL, NOCACHE, true),     // Tracking on
+  CMD("Td", BOOL, NOCACHE, true),     // Tracking off
+  MOVE("hP", BOOL, LX200_MOTION_START),   // Park
+  CMD("hR", BOOL, NOCACHE, true),     // Unpark
+  MOVE("hC", NONE, LX200_MOTION_START),   // Move to home
+};
+
+#define CMD_COUNT (sizeof(cmdTable) / sizeof(cmdTable[0]))
+
+// Anything not in the table is forwarded as is, alone on the wire since
+// its reply could be anything. Unknown commands other than gets may move
+// or reconfigure the mount, so they clear the cache.
+static constexpr LX200CmdDesc unknownGet =
+  { 0, BOOL, LX200_SHAPE_UNKNOWN, nullptr, LX200_REWRITE_NONE, nullptr, NOCACHE, false, LX200_MOTION_NONE, LX200_QUERY_NONE, LX200_BATCH_NONE };
+static constexpr LX200CmdDesc unknownCmd =
+  { 0, BOOL, LX200_SHAPE_UNKNOWN, nullptr, LX200_REWRITE_NONE, nullptr, NOCACHE, true, LX200_MOTION_NONE, LX200_QUERY_NONE, LX200_BATCH_NONE };
+
+// The 0x06 mount type query (Stellarium Mobile), "A" for alt-az
+static constexpr LX200CmdDesc ackCmd = LOCAL("", "A");
+
+// ============== Perfect Hash ============================
+// slot = (key * multiplier) >> (32 - HASH_BITS). The multiplier is searched
+// for at compile time until every opcode in the table lands in its own slot.
+#define HASH_BITS  9
+#define HASH_SLOTS (1u << HASH_BITS)
+
+static constexpr uint32_t hashSlot(uint32_t key, uint32_t mult) {
+  return (uint32_t)(key * mult) >> (32 - HASH_BITS);
+}
+
+static constexpr bool collisionFree(uint32_t mult) {
+  bool used[HASH_SLOTS] = {};
+  for (size_t i = 0; i < CMD_COUNT; i++) {
+    uint32_t s = hashSlot(cmdTable[i].key, mult);
+    if (used[s]) return false;
+    used[s] = true;
+  }
+  return true;
+}
+
+static constexpr uint32_t findMultiplier() {
+  uint32_t mult = 0x9E3779B1;  // golden ratio, a good start for multiplicative hashing
+  while (!collisionFree(mult)) mult += 2;
+  return mult;
+}
+
+static constexpr uint32_t hashMult = findMultiplier();
+
+struct SlotTable {
+  uint8_t entry[HASH_SLOTS];  // index into cmdTable + 1, 0 = empty
+};
+
+static constexpr SlotTable buildSlots() {
+  SlotTable t = {};
+  for (size_t i = 0; i < CMD_COUNT; i++) t.entry[hashSlot(cmdTable[i].key, hashMult)] = (uint8_t)(i + 1);
+  return t;
+}
+
+static constexpr SlotTable slotTable = buildSlots();
+
+static_assert(CMD_COUNT < 255, "command table too large for uint8_t slots");
+static_assert(collisionFree(hashMult), "perfect hash has collisions");
+
+// Packed opcode of a ":...#" command
+uint32_t lx200CmdKey(const char *cmd) {
+  if (cmd[0] != ':') return 0;
+  const char *body = cmd + 1;
+  const char *hash = strchr(body, '#');
+  size_t len = hash ? (size_t)(hash - body) : strlen(body);
+
+  char op[4] = { 0, 0, 0, 0 };
+  if (len > 3) len = 2;  // opcode followed by arguments
+  memcpy(op, body, len);
+  return lx200OpKey(op);
+}
+
+// ============== Lookup ==================================
+const LX200CmdDesc &lx200Lookup(const char *cmd) {
+  if (cmd[0] == LX200_ACK) return ackCmd;
+  uint32_t key = lx200CmdKey(cmd);
+  uint8_t e = slotTable.entry[hashSlot(key, hashMult)];
+  if (e != 0 && cmdTable[e - 1].key == key) return cmdTable[e - 1];
+  return cmd[1] == 'G' ? unknownGet : unknownCmd;
+}
@@ -0,0 +1,95 @@
+#ifndef LX200_COMMANDS_H
+#define LX200_COMMANDS_H
+
+#include <Arduino.h>
+
+// LX200 command descriptors. Everything the bridge needs to know about a
+// command (what OnStepX replies, local answers, client quirks, caching)
+// lives in one table in LX200Commands.cpp, looked up in O(1) through a
+// perfect hash over the opcode that is built at compile time.
+//
+// The opcode is the text between ':' and '#' when that is at most three
+// characters (":GR#" -> "GR", ":GVP#" -> "GVP", ":Q#" -> "Q"), otherwise
+// the first two characters (":Sr12:34:56#" -> "Sr").
+
+enum LX200Reply : uint8_t {
+  LX200_REPLY_NONE,    // OnStepX sends nothing back
+  LX200_REPLY_BOOL,    // "1#"/"0#", the '#' is stripped for the client
+  LX200_REPLY_STRING   // '#' terminated string, passed through as is
+};
+
+// What the Teensy sends back, so the link can end a reply the moment it is
+// complete instead of waiting out a timeout
+enum LX200ReplyShape : uint8_t {
+  LX200_SHAPE_NONE,        // nothing at all
+  LX200_SHAPE_TERMINATED,  // string ending in '#'
+  LX200_SHAPE_CHAR,        // one character, "1"/"0" or a digit; firmware may append '#'
+  LX200_SHAPE_UNKNOWN      // not in the table: up to a '#', a bare "0" if OnStepX doesn't know
+                           // it, or nothing at all. Nothing is written behind it.
+};
+
+enum LX200Rewrite : uint8_t {
+  LX200_REWRITE_NONE,
+  LX200_REWRITE_TZ_DECIMAL  // ":SG+06.0#" -> ":SG+06#", OnStep has no decimal timezone
+};
+
+// How a command moves the mount, so the prefetcher knows when to poll fast
+enum LX200Motion : uint8_t {
+  LX200_MOTION_NONE,
+  LX200_MOTION_START,  // goto, park, home: ends by itself
+  LX200_MOTION_MOVE,   // manual move, runs until a stop
+  LX200_MOTION_STOP    // abort or end of a manual move
+};
+
+// Queries about the bridge itself, answered locally
+enum LX200Query : uint8_t {
+  LX200_QUERY_NONE,
+  LX200_QUERY_STATS   // ":XH#" latency histograms, see BridgeStats.h
+};
+
+// Goto sequences and the settings apps send on connect are a string of
+// set commands, each waiting on its own round-trip. Held sets are
+// acknowledged by the bridge and go to the Teensy together, ahead of the
+// client's next command.
+enum LX200Batch : uint8_t {
+  LX200_BATCH_NONE,
+  LX200_BATCH_HOLD,   // target/site set, acknowledged here and held
+  LX200_BATCH_COMMIT  // goto/sync: waits for the held sets, refused if one failed
+};
+
+enum LX200Cache : uint8_t {
+  LX200_CACHE_NONE,
+  LX200_CACHE_POSITION,  // reused for CACHE_POSITION_TTL_MS
+  LX200_CACHE_SETTING    // reused until a set command clears the cache
+};
+
+struct LX200CmdDesc {
+  uint32_t key;               // packed opcode, see lx200OpKey()
+  LX200Reply reply;
+  LX200ReplyShape shape;      // what the Teensy sends, see LX200ReplyShape
+  const char *localReply;     // answered by the bridge, never sent to the Teensy
+  LX200Rewrite rewrite;       // fixup applied before sending to the Teensy
+  const char *replyOverride;  // sent to the client instead of a non-empty Teensy reply
+  LX200Cache cache;
+  bool invalidatesCache;      // moves the mount or changes a setting
+  LX200Motion motion;
+  LX200Query query;           // bridge query answered locally
+  LX200Batch batch;
+};
+
+constexpr uint32_t lx200OpKey(const char *op) {
+  return op[0] == '\0' ? 0 :
+         (uint32_t)(uint8_t)op[0] |
+         (op[1] == '\0' ? 0 : ((uint32_t)(uint8_t)op[1] << 8) |
+                              (uint32_t)(uint8_t)op[2] << 16);
+}
+
+constexpr LX200ReplyShape lx200ShapeFor(LX200Reply reply) {
+  return reply == LX200_REPLY_NONE ? LX200_SHAPE_NONE :
+         reply == LX200_REPLY_BOOL ? LX200_SHAPE_CHAR : LX200_SHAPE_TERMINATED;
+}
+
+uint32_t lx200CmdKey(const char *cmd);
+const LX200CmdDesc &lx200Lookup(const char *cmd);
+
+#endif // LX200_COMMANDS_H
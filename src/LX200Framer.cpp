@@ -0,0 +1,39 @@
+#include "LX200Framer.h"
+
+void LX200Framer::reset() {
+  len = 0;
+  buf[0] = '\0';
+  receiving = false;
+}
+
+// Feed one byte from the client. A command starts at ':' and ends at '#'.
+// Anything between commands is discarded, this includes the '#' that
+// Stellarium Mobile puts in front of ':' many times.
+LX200FrameEvent LX200Framer::feed(char c) {
+  // Stellarium Mobile sends 0x06 to check for LX200 mount type
+  if (c == LX200_ACK) return LX200_FRAME_ACK;
+
+  if (!receiving) {
+    if (c == ':') {
+      receiving = true;
+      buf[0] = ':';
+      len = 1;
+    }
+    return LX200_FRAME_NONE;
+  }
+
+  // Too long to be a real command, drop it and wait for the next ':'
+  if (len >= LX200_CMD_MAX_LEN) {
+    reset();
+    return LX200_FRAME_NONE;
+  }
+
+  buf[len++] = c;
+  buf[len] = '\0';
+
+  if (c == '#') {
+    receiving = false;
+    return LX200_FRAME_COMMAND;
+  }
+  return LX200_FRAME_NONE;
+}
@@ -0,0 +1,48 @@
+#ifndef LX200_FRAMER_H
+#define LX200_FRAMER_H
+
+#include <Arduino.h>
+
+// Longest LX200 command we accept from a client, e.g. ":Sr12:34:56#" or
+// ":SC05/25/25#". Anything longer is junk and gets dropped.
+#define LX200_CMD_MAX_LEN 32
+
+// Longest reply kept from the Teensy, longer ones are cut short but keep
+// their '#'
+#define LX200_REPLY_MAX_LEN 48
+
+#define LX200_ACK 0x06
+
+// A view into a framed command. Points into the framer's own buffer, is always
+// NUL terminated and stays valid until the next byte is fed to that framer.
+struct LX200Slice {
+  const char *data;
+  uint8_t len;
+
+  bool equals(const char *s) const { return strcmp(data, s) == 0; }
+  bool startsWith(const char *s) const { return strncmp(data, s, strlen(s)) == 0; }
+};
+
+enum LX200FrameEvent : uint8_t {
+  LX200_FRAME_NONE,     // byte consumed, nothing complete yet
+  LX200_FRAME_ACK,      // 0x06 mount type query (Stellarium Mobile)
+  LX200_FRAME_COMMAND   // a complete ":...#" command is available
+};
+
+// Fixed-capacity LX200 command framer, one per client connection.
+// No heap allocation: bytes are framed in place into a static buffer.
+class LX200Framer {
+  public:
+    LX200Framer() { reset(); }
+
+    void reset();
+    LX200FrameEvent feed(char c);
+    LX200Slice command() const { return { buf, len }; }
+
+  private:
+    char buf[LX200_CMD_MAX_LEN + 1];
+    uint8_t len;
+    bool receiving;
+};
+
+#endif // LX200_FRAMER_H
@@ -0,0 +1,565 @@
+#include <lwip/sockets.h>
+#include "LX200Server.h"
+#include "BridgeConfig.h"
+#include "TeensyLink.h"
+#include "ResponseCache.h"
+#include "LX200Commands.h"
+#include "BridgeStats.h"
+#include "BridgeTrace.h"
+#include "TelemetryPrefetch.h"
+#include "SessionCapture.h"
+
+#define LX200_JOB_QUEUE_LEN     8      // commands per client awaiting a reply
+#define LX200_BATCH_LEN         6      // set commands held per client
+#define LX200_RX_CHUNK         64      // bytes taken from the socket per read
+#define LX200_TX_BACKLOG      512      // unsent reply bytes before a client is dropped
+#define LX200_CLIENT_TIMEOUT    10000  // Not sure of the exact minimum but 10 sec works all the time
+
+WiFiServer lx200Server(LX200_PORT);
+
+const char* getAsciiLabel(uint8_t c) {
+  static char label[4];  // must be static to return a valid pointer
+
+  switch (c) {
+    case '\r': return "\\r";
+    case '\n': return "\\n";
+    case '\t': return "\\t";
+    default:
+      if (isprint(c)) {
+        label[0] = (char)c;
+        label[1] = '\0';
+        return label;
+      } else {
+        return ".";
+      }
+  }
+}
+
+// A command framed from a client, waiting on its reply
+struct LX200Job {
+  char cmd[LX200_CMD_MAX_LEN + 1];        // as received from the client
+  char teensyCmd[LX200_CMD_MAX_LEN + 1];  // after quirk fixups
+  const LX200CmdDesc *desc;
+  char response[LX200_REPLY_MAX_LEN + 1];  // filled by the link or the cache
+  const char *reply;                      // what goes to the client, response or a canned reply
+  uint8_t replyLen;
+  TeensyTicket ticket;                    // TEENSY_NO_TICKET when answered here
+  bool submitted;                         // handed to the Teensy link
+  bool fillsCache;                        // its reply will be cached
+  bool waitsCache;                        // waiting on another client's identical poll
+  bool viaLink;                           // reply came from the Teensy, times are valid
+  uint32_t rxAt;                          // micros() when the command was framed
+  TeensyTimes times;
+};
+
+// A set command already acknowledged to the client, see LX200Batch
+struct LX200HeldSet {
+  char cmd[LX200_CMD_MAX_LEN + 1];
+  char response[LX200_REPLY_MAX_LEN + 1];
+  TeensyTicket ticket;
+};
+
+// One connected planetarium app. Each has its own framer and job queue so
+// replies are routed back to the socket the command came from.
+struct LX200Conn {
+  WiFiClient client;
+  bool active;
+  LX200Framer framer;
+  LX200Job jobs[LX200_JOB_QUEUE_LEN];
+  uint8_t jobHead;
+  uint8_t jobCount;
+  uint8_t submitted;     // jobs[jobHead .. jobHead+submitted) are on the link
+  uint8_t rxBuf[LX200_RX_CHUNK];
+  uint8_t rxPos;         // rxBuf[rxPos .. rxLen) is still to be framed
+  uint8_t rxLen;
+  uint32_t rxAt;         // micros() when rxBuf was filled
+  char txBuf[LX200_TX_BACKLOG];
+  uint16_t txLen;        // replies queued, sent once per pass
+  bool txOverflow;       // client stopped reading, drop it
+  LX200HeldSet held[LX200_BATCH_LEN];
+  uint8_t heldCount;
+  uint8_t heldSent;      // held[0 .. heldSent) are on the link
+  bool heldFailed;       // the Teensy rejected a held set, refuse the next goto/sync
+  unsigned long heldSince;
+  unsigned long lastActivity;
+
+  LX200Job &job(uint8_t i) { return jobs[(jobHead + i) % LX200_JOB_QUEUE_LEN]; }
+};
+
+static LX200Conn conns[LX200_MAX_CLIENTS];
+static uint8_t rrNext = 0;  // client that gets the first link slot next time
+
+// Prepare a command for the Teensy. Returns false if it was answered here.
+static bool prepareLX200Command(LX200Job &job) {
+  job.desc = &lx200Lookup(job.cmd);
+  job.reply = job.response;
+  job.replyLen = 0;
+  if (job.desc->localReply != nullptr) {
+    job.reply = job.desc->localReply;
+    job.replyLen = strlen(job.reply);
+    return false;
+  }
+  // Formatted straight into the output, see sendLX200Response()
+  if (job.desc->query == LX200_QUERY_STATS) return false;
+
+  strcpy(job.teensyCmd, job.cmd);
+
+  //Handle Specific: SkySafari is sending an unsupported format for timezone in OnStep
+  //so truncate the decimal, e.g. ":SG+06.0#" -> ":SG+06#"
+  if (job.desc->rewrite == LX200_REWRITE_TZ_DECIMAL) {
+    char *dot = strchr(job.teensyCmd, '.');
+    if (dot != nullptr && strcmp(dot, ".0#") == 0) {
+      dot[0] = '#';
+      dot[1] = '\0';
+    }
+  }
+  //SERIAL_DEBUG.print("truncCmd="); SERIAL_DEBUG.println(job.teensyCmd);
+  return true;
+}
+
+// Acknowledge a set now and keep it for the next write to the Teensy. A
+// new batch sets a new target, an earlier rejected one no longer matters.
+static void holdLX200Set(LX200Conn &c, LX200Job &job) {
+  if (c.heldCount == 0) {
+    c.heldSince = millis();
+    c.heldFailed = false;
+  }
+  strcpy(c.held[c.heldCount++].cmd, job.teensyCmd);
+  job.reply = "1#";
+  job.replyLen = 2;
+  job.submitted = true;
+}
+
+/// =============Process LX200 Command =====================
+// Process the LX200 incoming command and determine if it needs to be
+//    fetched from Teensy, no return, or return a special string from here.
+//    Commands for the Teensy are queued on the link by scheduleLX200Jobs().
+//    Repeated polls are answered from the response cache.
+static void processLX200Command(LX200Conn &c, LX200Job &job) {
+  job.ticket = TEENSY_NO_TICKET;
+  job.fillsCache = job.waitsCache = job.viaLink = false;
+  job.submitted = !prepareLX200Command(job);
+  if (job.submitted) return;
+
+  if (job.desc->invalidatesCache) cacheInvalidate();
+  if (job.desc->motion != LX200_MOTION_NONE) prefetchNoteMotion(job.desc->motion);
+  if (LX200_BATCH_SETS && job.desc->batch == LX200_BATCH_HOLD && c.heldSent == 0 && c.heldCount < LX200_BATCH_LEN) {
+    holdLX200Set(c, job);
+    return;
+  }
+  if (job.desc->cache == LX200_CACHE_NONE) return;
+
+  job.replyLen = cacheLookup(job.teensyCmd, job.response);
+  if (job.replyLen != 0) {
+    job.submitted = true;
+  } else if (cacheFilling(job.teensyCmd)) {
+    job.submitted = job.waitsCache = true;
+  } else {
+    job.fillsCache = true;
+  }
+}
+
+// Stops and manual moves take the link's priority lane
+static bool isUrgent(const LX200Job &job) {
+  return job.desc->motion == LX200_MOTION_STOP || job.desc->motion == LX200_MOTION_MOVE;
+}
+
+// Hand a job to the Teensy link. Returns false if the link is full.
+static bool submitLX200Job(LX200Job &job) {
+  job.ticket = teensySubmit(job.teensyCmd, job.response, job.desc->shape, isUrgent(job));
+  if (job.ticket == TEENSY_NO_TICKET) return false;
+  if (job.fillsCache) cacheMarkFilling(job.teensyCmd);
+  job.submitted = true;
+  return true;
+}
+
+static bool jobReady(LX200Job &job) {
+  if (!job.submitted) return false;
+
+  if (job.waitsCache) {
+    job.replyLen = cacheLookup(job.teensyCmd, job.response);
+    if (job.replyLen != 0) {
+      job.waitsCache = false;
+      return true;
+    }
+    // The fill failed or was invalidated, ask the Teensy ourselves
+    if (!cacheFilling(job.teensyCmd) && submitLX200Job(job)) job.waitsCache = false;
+    return false;
+  }
+
+  if (job.ticket == TEENSY_NO_TICKET) return true;
+  if (!teensyDone(job.ticket)) return false;
+  job.replyLen = teensyTakeResponse(job.ticket, &job.times);
+  job.ticket = TEENSY_NO_TICKET;
+  job.viaLink = true;
+  if (job.fillsCache) cacheStore(job.teensyCmd, job.response, job.replyLen);
+  return true;
+}
+
+// ============== Client Output ===========================
+// Replies are queued per client and sent once per pass, so everything
+// answered in the same pass goes out as one TCP segment.
+static void queueLX200Output(LX200Conn &c, const char *data, size_t len) {
+  if (c.txLen + len > LX200_TX_BACKLOG) {
+    c.txOverflow = true;
+    return;
+  }
+  memcpy(c.txBuf + c.txLen, data, len);
+  c.txLen += len;
+}
+
+// Send what is queued without blocking. WiFiClient::write() waits for
+// room in the socket, which a stalled phone could make take seconds, so
+// go to the socket directly and keep whatever it won't take yet.
+static bool flushLX200Client(LX200Conn &c) {
+  if (c.txLen == 0) return false;
+  int n = send(c.client.fd(), c.txBuf, c.txLen, MSG_DONTWAIT);
+  if (n <= 0) return false;  // full, or gone and connected() will notice
+  CAPTURE(CAP_CLIENT_OUT, (uint8_t)(&c - conns), c.txBuf, n);
+  c.txLen -= n;
+  memmove(c.txBuf, c.txBuf + n, c.txLen);
+  return true;
+}
+
+// ============== Send LX200 Response =====================
+// Apply the client quirks to a response and queue it. The quirks only
+// move the reply slice, nothing is copied until it goes into txBuf.
+// Returns the number of bytes queued.
+static size_t sendLX200Response(LX200Conn &c, LX200Job &job) {
+  const char *reply = job.reply;
+  size_t len = job.replyLen;
+
+  // Skipping response
+  if (job.desc->reply == LX200_REPLY_NONE) return 0;
+
+  if (job.desc->query == LX200_QUERY_STATS) {
+    len = statsSummary(c.txBuf + c.txLen, LX200_TX_BACKLOG - c.txLen);
+    if (len == 0) c.txOverflow = true;
+    c.txLen += len;
+    return len;
+  }
+
+   // Remove hash from bool responses
+  if (job.desc->reply == LX200_REPLY_BOOL && len == 2 && reply[1] == '#' && (reply[0] == '1' || reply[0] == '0')) {
+    len = 1;
+  }
+
+  if (len > 0) {
+    // Client specific reply in place of what OnStepX sent (:SC, :Q#)
+    if (job.desc->replyOverride != nullptr) {
+      reply = job.desc->replyOverride;
+      len = strlen(reply);
+    }
+
+    queueLX200Output(c, reply, len);
+  }
+  return len;
+}
+
+// Feed the latency histograms and the trace once the reply is on its way
+// to the client
+static void recordLX200Stats(const LX200Job &job, uint8_t client, size_t len) {
+  if (job.cmd[0] == LX200_ACK) {
+    TRACE_COMMAND(TRACE_ACK, 0, client);
+    return;
+  }
+  uint32_t opKey = job.desc->key != 0 ? job.desc->key : lx200CmdKey(job.cmd);
+  uint32_t totalUs = micros() - job.rxAt;
+  uint32_t linkUs = job.viaLink ? job.times.replied - job.times.submitted : 0;
+  uint32_t uartUs = job.viaLink ? job.times.replied - job.times.written : 0;
+
+  statsRecord(opKey, STAT_TOTAL, totalUs);
+  if (job.viaLink) {
+    uint32_t sendUs = job.times.written - job.rxAt;
+    statsRecord(opKey, STAT_LINK, linkUs);
+    statsRecord(opKey, STAT_UART, uartUs);
+    statsRecord(opKey, STAT_SEND, sendUs);
+    if (isUrgent(job)) {
+      statsRecord(STATS_KEY_URGENT, STAT_TOTAL, totalUs);
+      statsRecord(STATS_KEY_URGENT, STAT_SEND, sendUs);
+    }
+  }
+  TRACE_COMMAND(job.desc->reply == LX200_REPLY_NONE ? TRACE_NO_RESPONSE : TRACE_CMD,
+                opKey, client, (uint8_t)len, totalUs, linkUs, uartUs);
+}
+
+static void dropLX200Client(LX200Conn &c) {
+  for (uint8_t i = 0; i < c.jobCount; i++) {
+    LX200Job &job = c.job(i);
+    if (job.ticket != TEENSY_NO_TICKET && job.fillsCache) cacheAbort(job.teensyCmd);
+    teensyRelease(job.ticket);
+  }
+  for (uint8_t i = 0; i < c.heldSent; i++) teensyRelease(c.held[i].ticket);
+  // The client was told its held sets were taken, so they still go out
+  for (uint8_t i = c.heldSent; i < c.heldCount; i++) {
+    if (teensySubmit(c.held[i].cmd, nullptr, lx200Lookup(c.held[i].cmd).shape) == TEENSY_NO_TICKET) {
+      SERIAL_DEBUG.printf("[LX200] Client %d: link full, held sets lost\n", (int)(&c - conns));
+      break;
+    }
+  }
+  c.jobHead = c.jobCount = c.submitted = 0;
+  c.heldCount = c.heldSent = 0;
+  c.txLen = 0;
+  c.client.stop();
+  CAPTURE(CAP_DISCONNECT, (uint8_t)(&c - conns), nullptr, 0);
+  c.active = false;
+  SERIAL_DEBUG.printf("[LX200] Client %d disconnected\n", (int)(&c - conns));
+}
+
+// Take a new connection if there is a free slot, otherwise turn it away
+// so it doesn't hang waiting on a busy bridge.
+static bool acceptLX200Client() {
+  WiFiClient client = lx200Server.available();
+  if (!client || !client.connected()) return false;
+
+  for (uint8_t i = 0; i < LX200_MAX_CLIENTS; i++) {
+    LX200Conn &c = conns[i];
+    if (c.active) continue;
+    c.client = client;
+    c.client.setNoDelay(true);  // <-- important
+    c.framer.reset();
+    c.jobHead = c.jobCount = c.submitted = 0;
+    c.heldCount = c.heldSent = 0;
+    c.heldFailed = false;
+    c.rxPos = c.rxLen = 0;
+    c.txLen = 0;
+    c.txOverflow = false;
+    c.lastActivity = millis();
+    c.active = true;
+    CAPTURE(CAP_CONNECT, i, nullptr, 0);
+    SERIAL_DEBUG.printf("[LX200] Client %d connected\n", i);
+    return true;
+  }
+
+  SERIAL_DEBUG.println("[LX200] No free client slot, connection refused");
+  client.stop();
+  return true;
+}
+
+// Frame whatever bytes this client has sent and queue the commands.
+// Returns true if anything arrived.
+static bool readLX200Client(LX200Conn &c) {
+  bool busy = false;
+
+  // Queue every command the client has already sent (e.g. SkySafari's
+  // back-to-back :GR#:GD#) so the link can pipeline them. After :RS#,
+  // which returns nothing, SkySafari immediately sends another command
+  // (e.g. :GD#) and it must not be missed.
+  while (c.jobCount < LX200_JOB_QUEUE_LEN) {
+    // Take what the socket has in one read rather than a call per byte.
+    // Bytes left over when the job queue fills are framed next time.
+    if (c.rxPos == c.rxLen) {
+      int n = c.client.read(c.rxBuf, sizeof(c.rxBuf));
+      if (n <= 0) break;
+      CAPTURE(CAP_CLIENT_IN, (uint8_t)(&c - conns), c.rxBuf, n);
+      c.rxPos = 0;
+      c.rxLen = n;
+      c.rxAt = micros();
+      c.lastActivity = millis();  // Reset timeout on each read
+      busy = true;
+    }
+
+    // Frame every command in the chunk in one pass
+    while (c.rxPos < c.rxLen && c.jobCount < LX200_JOB_QUEUE_LEN) {
+      char ch = c.rxBuf[c.rxPos++];
+      //Serial.printf("Received from client, byte: 0x%02X (%s)\n", (uint8_t)ch, getAsciiLabel((uint8_t)ch));
+
+      LX200FrameEvent ev = c.framer.feed(ch);
+
+      // Stellarium Mobile sends 0x06 to check for LX200 mount type. It is
+      // answered locally, but behind the replies the client is still owed.
+      if (ev == LX200_FRAME_ACK) {
+        LX200Job &job = c.job(c.jobCount++);
+        job.cmd[0] = LX200_ACK;
+        job.cmd[1] = '\0';
+        job.rxAt = c.rxAt;
+        processLX200Command(c, job);
+        continue;
+      }
+
+      if (ev == LX200_FRAME_COMMAND) {
+        LX200Job &job = c.job(c.jobCount++);
+        LX200Slice lx200Cmd = c.framer.command();
+        memcpy(job.cmd, lx200Cmd.data, lx200Cmd.len + 1);
+        job.rxAt = c.rxAt;
+        processLX200Command(c, job);
+      }
+    }
+  }
+  return busy;
+}
+
+// ============== Held Sets ===============================
+// Held sets go to the link together, ahead of the client's next command
+// for the Teensy or on their own once the client has gone quiet. Returns
+// false if the link is full.
+static bool submitLX200Held(LX200Conn &c) {
+  while (c.heldSent < c.heldCount) {
+    LX200HeldSet &h = c.held[c.heldSent];
+    h.ticket = teensySubmit(h.cmd, h.response, lx200Lookup(h.cmd).shape);
+    if (h.ticket == TEENSY_NO_TICKET) return false;
+    c.heldSent++;
+  }
+  return true;
+}
+
+// Once the whole batch is answered, check it. A rejected set can't be
+// reported to the client any more, so the goto or sync that follows it
+// is refused instead.
+static void collectLX200Held(LX200Conn &c) {
+  if (c.heldCount == 0 || c.heldSent < c.heldCount) return;
+  for (uint8_t i = 0; i < c.heldCount; i++) {
+    if (!teensyDone(c.held[i].ticket)) return;
+  }
+  for (uint8_t i = 0; i < c.heldCount; i++) {
+    LX200HeldSet &h = c.held[i];
+    if (teensyTakeResponse(h.ticket) == 0 || h.response[0] != '1') {
+      SERIAL_DEBUG.printf("[LX200] Client %d: Teensy rejected %s\n", (int)(&c - conns), h.cmd);
+      c.heldFailed = true;
+    }
+  }
+  c.heldCount = c.heldSent = 0;
+  cacheInvalidate();  // settings read while the sets were held are stale
+}
+
+// Commands that act on the target wait for the held sets to be answered
+static bool waitsForHeld(LX200Conn &c, LX200Job &job) {
+  if (job.desc->batch != LX200_BATCH_COMMIT) return false;
+  if (c.heldCount > 0) return true;
+  if (c.heldFailed) {
+    c.heldFailed = false;
+    job.reply = job.desc->reply == LX200_REPLY_BOOL ? "0" : "9";  // OnStepX: unspecified error
+    job.replyLen = 1;
+    job.submitted = true;
+  }
+  return false;
+}
+
+// ============== Urgent Jobs =============================
+// A stop or manual move goes to the link ahead of the client's earlier
+// commands, as long as none of those moves the mount itself (a stop must
+// not overtake the goto it ends). Replies still go back in order.
+static bool submitUrgentJobs() {
+  bool busy = false;
+  for (uint8_t n = 0; n < LX200_MAX_CLIENTS; n++) {
+    LX200Conn &c = conns[n];
+    if (!c.active) continue;
+    for (uint8_t k = c.submitted; k < c.jobCount; k++) {
+      LX200Job &job = c.job(k);
+      if (isUrgent(job)) {
+        if (job.submitted) continue;
+        if (!submitLX200Job(job)) return busy;
+        busy = true;
+      } else if (job.desc->motion != LX200_MOTION_NONE || job.desc->batch == LX200_BATCH_COMMIT) {
+        break;
+      }
+    }
+  }
+  return busy;
+}
+
+// ============== Schedule LX200 Jobs =====================
+// All clients share the one Teensy UART. Hand their commands to the link
+// round-robin, one per client per pass, so a client sending a burst can't
+// starve the others. Each client keeps its own commands in order.
+static bool scheduleLX200Jobs() {
+  bool busy = submitUrgentJobs();
+  bool progress = true;
+
+  while (progress) {
+    progress = false;
+    for (uint8_t n = 0; n < LX200_MAX_CLIENTS; n++) {
+      LX200Conn &c = conns[(rrNext + n) % LX200_MAX_CLIENTS];
+      if (!c.active) continue;
+
+      // Answered here, held sets included, no link slot needed
+      while (c.submitted < c.jobCount && c.job(c.submitted).submitted) {
+        c.submitted++;
+        busy = true;
+      }
+      collectLX200Held(c);
+      if (c.heldSent < c.heldCount && (c.submitted < c.jobCount || millis() - c.heldSince >= LX200_BATCH_HOLD_MS)) {
+        if (!submitLX200Held(c)) continue;
+        progress = busy = true;
+      }
+      if (c.submitted >= c.jobCount) continue;
+
+      LX200Job &job = c.job(c.submitted);
+      if (waitsForHeld(c, job)) continue;
+      // Link full, try next loop. Other clients still move on: a finished
+      // urgent job waits on its owner to free the slot.
+      if (!job.submitted && !submitLX200Job(job)) continue;
+      c.submitted++;
+      progress = busy = true;
+    }
+    rrNext = (rrNext + 1) % LX200_MAX_CLIENTS;
+  }
+  return busy;
+}
+
+// Send back the finished replies, in the order the commands arrived
+static bool writeLX200Client(LX200Conn &c) {
+  bool busy = false;
+  while (c.jobCount > 0 && c.submitted > 0 && jobReady(c.job(0))) {
+    size_t len = sendLX200Response(c, c.job(0));
+    recordLX200Stats(c.job(0), (uint8_t)(&c - conns), len);
+    c.jobHead = (c.jobHead + 1) % LX200_JOB_QUEUE_LEN;
+    c.jobCount--;
+    c.submitted--;
+    busy = true;
+  }
+  return busy;
+}
+
+void lx200ServerBegin() {
+  for (uint8_t i = 0; i < LX200_MAX_CLIENTS; i++) conns[i].active = false;
+  cacheBegin();
+  lx200Server.begin();
+}
+
+uint8_t lx200ClientCount() {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < LX200_MAX_CLIENTS; i++) n += conns[i].active;
+  return n;
+}
+
+// ============== Handle LX200 Clients ====================
+// Service every client connection without blocking. Returns true if
+// anything happened.
+bool handleLX200Clients() {
+  bool busy = acceptLX200Client();
+
+  for (uint8_t i = 0; i < LX200_MAX_CLIENTS; i++) {
+    LX200Conn &c = conns[i];
+    if (!c.active) continue;
+
+    if (!c.client.connected()) {
+      dropLX200Client(c);
+      busy = true;
+      continue;
+    }
+    if (millis() - c.lastActivity > LX200_CLIENT_TIMEOUT) {
+      SERIAL_DEBUG.println("[LX200] Client timeout.");
+      dropLX200Client(c);
+      busy = true;
+      continue;
+    }
+    busy |= readLX200Client(c);
+  }
+
+  busy |= scheduleLX200Jobs();
+
+  for (uint8_t i = 0; i < LX200_MAX_CLIENTS; i++) {
+    LX200Conn &c = conns[i];
+    if (!c.active) continue;
+    busy |= writeLX200Client(c);
+    if (c.txOverflow) {
+      SERIAL_DEBUG.printf("[LX200] Client %d is not reading its replies\n", i);
+      dropLX200Client(c);
+      busy = true;
+      continue;
+    }
+    busy |= flushLX200Client(c);
+  }
+  return busy;
+}
@@ -0,0 +1,18 @@
+#ifndef LX200_SERVER_H
+#define LX200_SERVER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "LX200Framer.h"
+
+#define LX200_PORT          4030  // standard LX200 TCP port
+#define LX200_MAX_CLIENTS      4  // e.g. SkySafari on a tablet and Stellarium on a phone
+
+// LX200 TCP server. Several planetarium apps can be connected at once,
+// their commands are multiplexed onto the single Teensy UART.
+
+void lx200ServerBegin();
+bool handleLX200Clients();
+uint8_t lx200ClientCount();
+
+#endif // LX200_SERVER_H
@@ -24,299 +24,142 @@
 #include <WiFiServer.h>
 #include <Wire.h>
 #include "OledDisplay.h"
+#include "LX200Server.h"
+#include "StellariumServer.h"
+#include "PositionBroadcast.h"
+#include "TeensyLink.h"
+#include "BridgeConfig.h"
+#include "BridgeStats.h"
+#include "BridgeTrace.h"
+#include "TelemetryPrefetch.h"
+#include "SessionCapture.h"
 #include "esp_wifi.h"
 #include "soc/soc.h"
 #include "soc/rtc_cntl_reg.h"
+#ifdef LX200_NATIVE
+#include "../include/secretsTemplate.h"  // host build, the credentials are not used
+#else
 #include "../include/secrets.h"
+#endif
 
 #define LX200_AP_SSID             "LX200-ESP32"
 #define LX200_AP_PASSWORD            "password"
 #define LX200_AP_IP_ADDR          {192,168,4,1} 
 #define LX200_AP_GW_ADDR          {192,168,4,1} 
 #define WIFI_DISPLAY_AP_IP_ADDR   {192,168,4,2} 
-
-#define SERIAL_TEENSY Serial1
-#define SERIAL_DEBUG Serial
+#define LX200_AP_MAX_STATIONS     10  // ESP32 softAP limit, shared by apps, Stellarium and broadcast viewers
 
 #define I2C_SDA D4 
 #define I2C_SCL D5 
 #define RESET_PIN D10 
 
-#define TEENSY_ACK_TIMEOUT 500
-
-WiFiServer lx200Server(4030);
-
-static bool receivingLX200 = false;
-volatile bool clientConnected = false;
-static int hashCount = 0;
-
-// Check for LX200 commands that need no response to client
-bool isNoResponseCommand(const String &cmd) {
-  return (
-    cmd == ":Me#"  ||  // Start moving East
-    cmd == ":Mn#"  ||  // Start moving North
-    cmd == ":Ms#"  ||  // Start moving South
-    cmd == ":Mw#"  ||  // Start moving West
-    cmd == ":Qe#"  ||  // Abort slew East
-    cmd == ":Qn#"  ||  // Abort slew North
-    cmd == ":Qs#"  ||  // Abort slew South
-    cmd == ":Qw#"  ||  // Abort slew West
-    cmd == ":RC#"  ||  // Set slew rate to centering
-    cmd == ":RF#"  ||  // Set slew rate to fast
-    cmd == ":RG#"  ||  // Set slew rate to guiding
-    cmd == ":RM#"  ||  // Set slew rate to find
-    cmd == ":RS#"  ||  // Set slew rate to max, or Sync for LX200 classic
-    cmd == ":W1#"  ||  // Set site 1
-    cmd == ":CS#"      // Synchronize the telescope with current RA/DEC
-  );
-}
-
-// Check for LX200 commands that are Specific to this App
-String checkForAppSpecificCmds(const String &cmd) {
-  if (cmd == ":GVP#")  return "On-Step#";//"OnStepX.DDScopeX#"; // Product Name
-  if (cmd == ":GVN#")  return "2.0#";        // Firmware Version
-  if (cmd == ":GVD#")  return "May 2025#";   // Firmware Date
-  if (cmd == ":GVT#")  return "08:02:00#";   // Telescope Firmware time
-  //if (cmd == ":D#")    return "#";         // Requests a string of bars indicating the distance to the current target location
-  //if (cmd == ":CM#")   return "Syncd Object#"; 
-  //if (cmd == ":GW#")   return "AN1#";      // Get Scope alignment status <mount><tracking><alignment>
-                                             //   mount: A-AzEl mounted, P-Equatorially mounted, G-german mounted equatorial
-                                             //   tracking: T-tracking, N-not tracking
-                                             //   alignment: 0-needs alignment, 1-one star aligned, 2-two star aligned, 3-three star aligned
-  return "";
-}
-
-// :MS#   returns:
-    //              0=Goto is possible
-    //              1=below the horizon limit
-    //              2=above overhead limit
-    //              3=controller in standby
-    //              4=mount is parked
-    //              5=Goto in progress
-    //              6=outside limits (AXIS2_LIMIT_MAX, AXIS2_LIMIT_MIN, AXIS1_LIMIT_MIN/MAX, MERIDIAN_E/W)
-    //              7=hardware fault
-    //              8=already in motion
-    //              9=unspecified error
-
-const char* getAsciiLabel(uint8_t c) {
-  static char label[4];  // must be static to return a valid pointer
-
-  switch (c) {
-    case '\r': return "\\r";
-    case '\n': return "\\n";
-    case '\t': return "\\t";
-    default:
-      if (isprint(c)) {
-        label[0] = (char)c;
-        label[1] = '\0';
-        return label;
-      } else {
-        return ".";
-      }
+#define BOOT_CONSOLE_WAIT_MS 5000  // give up waiting for a debug terminal after this
+
+// ================== Boot Phases ================
+// Startup is staged so the AP and port 4030 are served first. Joining the
+// home network, the OLED and the debug console all come up from loop(),
+// nobody waits on them. Each phase records when it finished so the boot
+// can be reported once somebody is listening on the debug port.
+enum BootPhase : uint8_t {
+  BOOT_TEENSY,    // Teensy serial and link started
+  BOOT_AP,        // access point up
+  BOOT_SERVER,    // LX200 and Stellarium servers accepting on ports 4030 and 10001
+  BOOT_OLED,      // display initialized
+  BOOT_STA,       // joined the home network
+  BOOT_PHASES
+};
+
+static const char *const bootPhaseName[BOOT_PHASES] = { "Teensy link", "Access Point", "LX200 server", "OLED", "STA connected" };
+static uint32_t bootPhaseMs[BOOT_PHASES];  // millis() when done, 0 = not yet
+static bool bootReported = false;
+static bool oledReady = false;
+static bool oledDirty = false;  // redraw when the loop is idle
+static String wdStaIp;          // WiFi Display STA address, from the Teensy
+
+static void bootPhaseDone(BootPhase phase) {
+  bootPhaseMs[phase] = millis();
+  if (bootPhaseMs[phase] == 0) bootPhaseMs[phase] = 1;
+  if (bootReported) {
+    SERIAL_DEBUG.printf("[Boot] %s at %lu ms\n", bootPhaseName[phase], (unsigned long)bootPhaseMs[phase]);
   }
 }
 
-// ================ Handshake Teensy =====================
-// Handshake Teensy: Send 'L' and wait for 'K'
-void handshakeTeensy() {
-  SERIAL_TEENSY.write('L');
-  SERIAL_TEENSY.flush();
-
-  unsigned long ackStart = millis();
-  while ((millis() - ackStart) < TEENSY_ACK_TIMEOUT) {
-    if (SERIAL_TEENSY.available() && SERIAL_TEENSY.read() == 'K') {
-      delay(3);
-      // Flush any remaining pre-response garbage
-      while (SERIAL_TEENSY.available()) SERIAL_TEENSY.read();
-      break;
+// Print the phases once a debug terminal is attached. Phases that finish
+// later are printed as they happen.
+static bool reportBoot() {
+  if (bootReported) return false;
+  if (!SERIAL_DEBUG && millis() < BOOT_CONSOLE_WAIT_MS) return false;
+  bootReported = true;
+  SERIAL_DEBUG.println("Debug port started");
+  for (uint8_t i = 0; i < BOOT_PHASES; i++) {
+    if (bootPhaseMs[i] != 0) {
+      SERIAL_DEBUG.printf("[Boot] %s at %lu ms\n", bootPhaseName[i], (unsigned long)bootPhaseMs[i]);
+    } else {
+      SERIAL_DEBUG.printf("[Boot] %s pending\n", bootPhaseName[i]);
     }
   }
-}
-
-// ============= Read Teensy Response =====================
-String readTeensyResponse() {
-  String tResponse = "";
-  unsigned long startWait = millis();
-
-  // Wait for at least 1 byte
-  while ((millis() - startWait) < 2300) {
-    if (SERIAL_TEENSY.available()) break;
-  }
-
-  if (!SERIAL_TEENSY.available()) {
-    SERIAL_DEBUG.println("Timeout waiting for response ':'");
-    return "";  // Return minimal terminator to avoid client crash
-  }
-
-  // Read until '#' is received or timeout
-  unsigned long readStart = millis();
-  while ((millis() - readStart) < 450) {
-    while (SERIAL_TEENSY.available()) {
-      char rc = SERIAL_TEENSY.read();
-
-      // Skip early junk like stray 'K', '\n', etc.
-      if (rc == 'K' || rc == '\n' || rc == '\r') continue;
-
-      tResponse += rc;
-      if (rc == '#') {
-        return tResponse;
-      }
-    }
+  IPAddress lxApIpMsg = WiFi.softAPIP();
+  SERIAL_DEBUG.print("AP IP Address: ");
+  SERIAL_DEBUG.println(lxApIpMsg);
+  if (bootPhaseMs[BOOT_STA] != 0) {
+    SERIAL_DEBUG.print("STA IP Address: ");
+    SERIAL_DEBUG.println(WiFi.localIP());
   }
-
-  SERIAL_DEBUG.println("Timeout waiting for Teensy response '#'");
-  return tResponse;  // Might be partial
+  return true;
 }
 
-/// =============Process LX200 Command =====================
-// Process the LX200 incoming command and determine if it needs to be
-//    fetched from Teensy, no return, or return a special string from here.
-String processLX200Command(const String &cmd) {
-
-  String localResp = checkForAppSpecificCmds(cmd);
-  if (localResp.length() != 0) return localResp;
+// Station mode joins in the background, the AP is served meanwhile
+static bool serviceStation() {
+  bool connected = WiFi.status() == WL_CONNECTED;
+  if (connected == (bootPhaseMs[BOOT_STA] != 0)) return false;
 
-  String truncCmd = cmd;  // make a mutable copy
-
-  //Handle Specific: SkySafari is sending an unsupported format for timezone in OnStep
-  //so truncate the decimal
-  if (cmd == ":SG+06.0#") {
-    int dotIndex = truncCmd.indexOf('.');
-    int hashIndex = truncCmd.indexOf('#');
-
-    if (dotIndex != -1 && hashIndex != -1 && dotIndex < hashIndex) {
-      truncCmd = truncCmd.substring(0, dotIndex) + truncCmd.substring(hashIndex);
-    }
+  if (connected) {
+    bootPhaseDone(BOOT_STA);
+    SERIAL_DEBUG.print("STA IP Address: ");
+    SERIAL_DEBUG.println(WiFi.localIP());
+    SERIAL_DEBUG.printf("WiFi RSSI: %d dBm\n", WiFi.RSSI());
+  } else {
+    bootPhaseMs[BOOT_STA] = 0;  // lost it, auto reconnect is on
+    SERIAL_DEBUG.println("STA disconnected");
   }
-
-  //SERIAL_DEBUG.print("truncCmd="); SERIAL_DEBUG.println(truncCmd);
-  handshakeTeensy();
-  SERIAL_TEENSY.print(truncCmd);
-  SERIAL_TEENSY.flush();
-  return readTeensyResponse();
+  oledDirty = true;
+  return true;
 }
 
-// ============== Handle LX200 CLient =====================
-void handleLX200Client() {
-  WiFiClient client = lx200Server.available();
-
-  if (!client || !client.connected()) return;
-  client.setNoDelay(true);  // <-- important
-  String lx200Cmd = "";
-  bool receivingCmd = false;
-  unsigned long start = millis();
-
-  // Not sure of the exact minimum for timeout but 10 sec works all the time
-  while (client.connected()) {
-    if (millis() - start > 10000) {
-      SERIAL_DEBUG.println("[LX200] Client timeout.");
-      break;
-    }
-    while (client.available()) {
-      start = millis();  // Reset timeout on each byte
-      char c = client.read();
-      //Serial.printf("Received from client, byte: 0x%02X (%s)\n", (uint8_t)c, getAsciiLabel((uint8_t)c));
-
-      // Stellarium Mobile sends 0x06 to check for LX200 mount type
-      if (c == 0x06) {
-        client.print('A');
-        client.flush();
-        SERIAL_DEBUG.println("Sent 'A'");
-        continue;
-      }
-
-      // Wait for ':' to begin a new command, Stellarium mobile puts a '#' in front of ':' many times
-      if (!receivingCmd && c == ':') {
-        receivingCmd = true;
-        lx200Cmd = ":";
-        continue;
-      }
-
-      lx200Cmd += c;
-
-      if (c == '#' && receivingCmd) {
-        receivingCmd = false;
-
-        String response = processLX200Command(lx200Cmd);
-
-         // Remove hash from bool responses
-        if ((response == "1#" || response == "0#") && lx200Cmd != ":MS#") {
-          response = response.substring(0, 1);
-        }
-
-        // must use break; here and not return; or SkySafari disconnects
-        // because of the :RS# command, which returns nothing, is immediately
-        // followed by the client sending another command and the while loop must         
-        // get ready for next command quickly or misses the command. (e.g. :GD#)
-        if (isNoResponseCommand(lx200Cmd)) {
-          SERIAL_DEBUG.printf("Skipping response for: %s\n", lx200Cmd.c_str());
-          break;
-        }
-
-        if (response.length() > 0) {
-          // Stellarium wants this string and not the OnStep reply of "1#"
-          // So the :SC command was sent to OnStep but here we return this string instead.
-          if (lx200Cmd.startsWith(":SC")) {
-            response = "1Updating Planetary Data#          #";
-          }
-
-          // You MUST return a '1' ('#' get's stripped later) for Stellarium GOTO
-          // OnStepX returns nothing, just a '#'.
-          if (lx200Cmd == ":Q#") {
-            response = "1";
-          }
-
-          client.write((const uint8_t *)response.c_str(), response.length());
-          client.flush();
-          SERIAL_DEBUG.printf("CmdFromClient: %-13s  RespToClient: %s\n", lx200Cmd.c_str(), response.c_str());
-        }
-      }
-    }
-    yield();  // helps WiFi stack
+// The OLED is slow I2C, it is brought up and redrawn only when idle
+static bool serviceOled() {
+  if (!oledReady) {
+    if (bootPhaseMs[BOOT_OLED] != 0) return false;  // init failed, no display
+    oledReady = initOledDisplay();  // I2C on the ESP32-C3's default pins
+    bootPhaseDone(BOOT_OLED);
+    oledDirty = oledReady;
+    return true;
   }
+  if (!oledDirty) return false;
+  oledDirty = false;
+  updateOledDisplay(WiFi.localIP(), LX200_AP_IP_ADDR, wdStaIp, WIFI_DISPLAY_AP_IP_ADDR);
+  return true;
 }
 
 // =================== SETUP =====================
 void setup() {
-  
-  delay(5000);  // this here to allow time to get the debug terminal going
-
+  // No waiting for a debug terminal, the boot is reported once one attaches
   SERIAL_DEBUG.begin(115200);
-  SERIAL_DEBUG.println("Debug port started");
 
-  // SERIAL_TEENSY.begin(460800, SERIAL_8N1, D7, D6);
-  SERIAL_TEENSY.begin(230400, SERIAL_8N1, D7, D6); //D7=RX, D6=TX
+  // Higher rates are negotiated with the Teensy once the link is up
+  SERIAL_TEENSY.begin(TEENSY_BAUD_BASE, SERIAL_8N1, D7, D6); //D7=RX, D6=TX
 
   pinMode(RESET_PIN, INPUT_PULLUP);
 
-  delay(5);
   // Disable brownout detector on the WeMos ESP32 D1 Mini if that is hardware used
   // WRITE_PERI_REG(RTC_CNTL_BROWN_OUT_REG, 0); //disable brownout detector
 
-  Serial.println("Starting TEENSY serial...");
-  delay(100);
-
   while (SERIAL_TEENSY.available()) SERIAL_TEENSY.read();  // Flush junk
-
-  // Initialize I2C on the ESP32-C3's default pins
-  initOledDisplay();
+  teensyLinkBegin();
+  bootPhaseDone(BOOT_TEENSY);
 
   // Using Dual mode Wifi
   WiFi.mode(WIFI_AP_STA);
-
-  // Start Station Mode WiFi
-  WiFi.begin(LX200_STA_SSID, LX200_STA_PASSWORD);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    SERIAL_DEBUG.print(".");
-  }
-
-  IPAddress lxStaIpMsg = WiFi.localIP();
-  SERIAL_DEBUG.print("\nSTA IP Address: ");
-  SERIAL_DEBUG.println(lxStaIpMsg);
-
-  delay(10);
-
   WiFi.setSleep(false);  // Prevent disconnects
 
   // Set static AP IP
@@ -325,52 +168,83 @@ void setup() {
     IPAddress(LX200_AP_GW_ADDR), 
     IPAddress(255,255,255,0));
 
-  // Now start AP :  Channel 1, hidden SSID off, max 1 client
-  bool apStarted = WiFi.softAP(LX200_AP_SSID, LX200_AP_PASSWORD, 1, 0, 1);
+  // Now start AP :  Channel 1, hidden SSID off. Stations are not just LX200
+  // clients, so the limit is the AP's own.
+  bool apStarted = WiFi.softAP(LX200_AP_SSID, LX200_AP_PASSWORD, 1, 0, LX200_AP_MAX_STATIONS);
   if (!apStarted) {
     SERIAL_DEBUG.println("Failed to start Access Point!");
   } else {
-    SERIAL_DEBUG.println("Access Point started");
+    bootPhaseDone(BOOT_AP);
   }
 
-  // Print AP IP address
-  IPAddress lxApIpMsg = WiFi.softAPIP();
-  SERIAL_DEBUG.print("AP IP Address: ");
-  SERIAL_DEBUG.println(lxApIpMsg);
-
-  // Start TCP server
-  lx200Server.begin();
-  SERIAL_DEBUG.println("LX200 TCP Server started on port 4030");
-  Serial.printf("WiFi RSSI: %d dBm\n", WiFi.RSSI());
+  // Start TCP servers
+  lx200ServerBegin();
+  stellariumServerBegin();
+  prefetchBegin();
+  broadcastBegin();
+  bootPhaseDone(BOOT_SERVER);
 
   WiFi.setTxPower(WIFI_POWER_19_5dBm);  // Max power 
+
+  // Start Station Mode WiFi, serviceStation() notices when it has joined
+  WiFi.setAutoReconnect(true);
+  WiFi.begin(LX200_STA_SSID, LX200_STA_PASSWORD);
 }
 
 // ====================== LOOP =======================
 unsigned long lastWifiIpCheck = 0;
 bool wifiIpReceived = false;
-IPAddress wdStaIp;
+TeensyTicket wdStaIpTicket = TEENSY_NO_TICKET;
+char wdStaIpReply[LX200_REPLY_MAX_LEN + 1];
 
-void loop() {
-  handleLX200Client();
-  yield();
+// Check for the IP Address of the Wifi Display ESP32 and display it on the OLED
+bool checkWifiDisplayIp() {
+  if (wifiIpReceived) return false;
 
-  // Check for the IP Address of the Wifi Display ESP32 and display it on the OLED
-  if (!wifiIpReceived && millis() - lastWifiIpCheck >= 15000) {
+  if (wdStaIpTicket == TEENSY_NO_TICKET) {
+    if (millis() - lastWifiIpCheck < 15000) return false;
     lastWifiIpCheck = millis();
-    
-    String wdStaIpMsg = processLX200Command(":GI#");
-    Serial.print("wdStaIpMsg = "); Serial.println(wdStaIpMsg);
-
-    // Only proceed if it is long enough and ends with '#'
-    if (wdStaIpMsg.length() > 4 && wdStaIpMsg.endsWith("#")) {
-      wdStaIpMsg.remove(wdStaIpMsg.length() - 1); // remove trailing '#'
-      wdStaIpMsg.trim();                          // remove newline/whitespace
-
-      IPAddress lxStaIpMsg = WiFi.localIP();
-      updateOledDisplay(lxStaIpMsg, LX200_AP_IP_ADDR, wdStaIpMsg, WIFI_DISPLAY_AP_IP_ADDR);
-      wifiIpReceived = true;  // Uncomment if you want to stop polling
-      Serial.print("got the IP Address from Teensy");
+    wdStaIpTicket = teensySubmit(":GI#", wdStaIpReply);
+    return true;
+  }
+
+  if (!teensyDone(wdStaIpTicket)) return false;
+  teensyTakeResponse(wdStaIpTicket);
+  String wdStaIpMsg = wdStaIpReply;
+  wdStaIpTicket = TEENSY_NO_TICKET;
+  Serial.print("wdStaIpMsg = "); Serial.println(wdStaIpMsg);
+
+  // Only proceed if it is long enough and ends with '#'
+  if (wdStaIpMsg.length() > 4 && wdStaIpMsg.endsWith("#")) {
+    wdStaIpMsg.remove(wdStaIpMsg.length() - 1); // remove trailing '#'
+    wdStaIpMsg.trim();                          // remove newline/whitespace
+
+    wdStaIp = wdStaIpMsg;
+    oledDirty = true;
+    wifiIpReceived = true;  // Uncomment if you want to stop polling
+    Serial.print("got the IP Address from Teensy");
+  }
+  return true;
+}
+
+// Nothing in the loop blocks. Each service returns true if it did any work,
+// when none did the loop sleeps a tick so the CPU idles and WiFi gets time.
+void loop() {
+  bool busy = handleLX200Clients();
+  busy |= handleStellariumClients();
+  busy |= teensyLinkService();
+  busy |= prefetchService();
+  busy |= broadcastService();
+  busy |= checkWifiDisplayIp();
+  busy |= reportBoot();
+  busy |= serviceStation();
+
+  // Type 's' on the debug console for the latency histograms, 'c' to
+  // dump the session capture
+  if (SERIAL_DEBUG.available()) {
+    switch (SERIAL_DEBUG.read()) {
+      case 's': statsPrint(SERIAL_DEBUG); break;
+      case 'c': captureDump(); break;
     }
   }
 
@@ -379,7 +253,17 @@ void loop() {
     SERIAL_DEBUG.println("Reset requested from Teensy");
     esp_restart();
   }
-}
 
+  // Format the trace only when idle and without ever blocking on the serial
+  if (!busy && SERIAL_DEBUG.availableForWrite() >= 128) {
+    busy = traceDrain(SERIAL_DEBUG, 2);
+  }
+  if (!busy && SERIAL_DEBUG.availableForWrite() >= 128) {
+    busy = captureDrain(SERIAL_DEBUG, 1);
+  }
 
+  if (!busy) busy = serviceOled();
 
+  // Sleep until the next Teensy reply, or 1 ms to poll the WiFi clients
+  if (!busy) teensyLinkWait(1);
+}
@@ -0,0 +1,107 @@
+#include "LinkTimeouts.h"
+
+#define RTO_GRANULARITY_US 1000  // smallest variance allowance
+
+// Smoothed latency in microseconds (RFC 6298: alpha 1/8, beta 1/4)
+struct Estimator {
+  uint32_t srtt;
+  uint32_t rttvar;
+  uint8_t samples;
+  uint8_t backoff;
+
+  void sample(uint32_t us) {
+    if (samples == 0) {
+      srtt = us;
+      rttvar = us / 2;
+    } else {
+      uint32_t err = us > srtt ? us - srtt : srtt - us;
+      rttvar = rttvar - rttvar / 4 + err / 4;
+      srtt = srtt - srtt / 8 + us / 8;
+    }
+    if (samples < 255) samples++;
+    backoff = 0;
+  }
+
+  void missed() {
+    if (backoff < LINK_TIMEOUT_MAX_BACKOFF) backoff++;
+  }
+
+  uint16_t timeoutMs(uint16_t minMs, uint16_t maxMs, uint8_t minSamples = LINK_TIMEOUT_MIN_SAMPLES) const {
+#if TEENSY_ADAPTIVE_TIMEOUTS
+    if (samples < minSamples) return maxMs;
+    uint32_t var = 4 * rttvar > RTO_GRANULARITY_US ? 4 * rttvar : RTO_GRANULARITY_US;
+    uint32_t ms = ((srtt + var + 999) / 1000) << backoff;
+    if (ms < minMs) return minMs;
+    if (ms > maxMs) return maxMs;
+    return ms;
+#else
+    (void)minMs;
+    (void)minSamples;
+    return maxMs;
+#endif
+  }
+};
+
+struct OpTimeouts {
+  uint32_t opKey;  // 0 = unused
+  unsigned long lastUsed;
+  Estimator firstByte;
+  Estimator reply;
+};
+
+static OpTimeouts ops[LINK_TIMEOUT_OPCODES];
+static Estimator ack;
+
+static OpTimeouts *find(uint32_t opKey) {
+  for (uint8_t i = 0; i < LINK_TIMEOUT_OPCODES; i++) {
+    if (ops[i].opKey == opKey) return &ops[i];
+  }
+  return nullptr;
+}
+
+// Entry for opKey, taking over the least recently used one if it is new
+static OpTimeouts &findOrAdd(uint32_t opKey) {
+  OpTimeouts *e = find(opKey);
+  if (e == nullptr) {
+    e = &ops[0];
+    for (uint8_t i = 1; i < LINK_TIMEOUT_OPCODES; i++) {
+      if (ops[i].opKey == 0 || ops[i].lastUsed < e->lastUsed) e = &ops[i];
+      if (ops[i].opKey == 0) break;
+    }
+    memset(e, 0, sizeof(*e));
+    e->opKey = opKey;
+  }
+  e->lastUsed = millis();
+  return *e;
+}
+
+ReplyTimeouts linkTimeoutsFor(uint32_t opKey) {
+  OpTimeouts *e = find(opKey);
+  if (e == nullptr) return { LINK_FIRST_BYTE_MAX_MS, LINK_REPLY_MAX_MS };
+  return { e->firstByte.timeoutMs(LINK_FIRST_BYTE_MIN_MS, LINK_FIRST_BYTE_MAX_MS),
+           e->reply.timeoutMs(LINK_REPLY_MIN_MS, LINK_REPLY_MAX_MS) };
+}
+
+void linkTimeoutsSample(uint32_t opKey, uint32_t firstByteUs, uint32_t replyUs) {
+  OpTimeouts &e = findOrAdd(opKey);
+  e.firstByte.sample(firstByteUs);
+  e.reply.sample(replyUs);
+}
+
+void linkTimeoutsMissed(uint32_t opKey) {
+  OpTimeouts &e = findOrAdd(opKey);
+  e.firstByte.missed();
+  e.reply.missed();
+}
+
+uint16_t linkAckTimeout() {
+  return ack.timeoutMs(LINK_ACK_MIN_MS, TEENSY_ACK_TIMEOUT, LINK_ACK_MIN_SAMPLES);
+}
+
+void linkAckSample(uint32_t us) {
+  ack.sample(us);
+}
+
+void linkAckMissed() {
+  ack.missed();
+}
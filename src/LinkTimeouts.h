@@ -0,0 +1,40 @@
+#ifndef LINK_TIMEOUTS_H
+#define LINK_TIMEOUTS_H
+
+#include <Arduino.h>
+#include "BridgeConfig.h"
+
+// Timeouts for replies from the Teensy, learned per opcode the way TCP
+// learns its retransmit timeout: a smoothed latency plus four times its
+// mean deviation, clamped to a floor and ceiling. Every timeout doubles
+// the window for that opcode until a reply arrives in time again.
+//
+// Two windows are tracked per opcode: command written -> first reply byte,
+// and first byte -> '#'. Until an opcode has LINK_TIMEOUT_MIN_SAMPLES
+// replies, or with TEENSY_ADAPTIVE_TIMEOUTS off, the ceilings are used.
+
+#define LINK_FIRST_BYTE_MAX_MS   2300  // wait for the first byte of a reply
+#define LINK_FIRST_BYTE_MIN_MS     20
+#define LINK_REPLY_MAX_MS         450  // then wait for the '#' terminator
+#define LINK_REPLY_MIN_MS          10
+#define LINK_ACK_MIN_MS            20  // 'L' -> 'K', ceiling TEENSY_ACK_TIMEOUT
+
+#define LINK_TIMEOUT_OPCODES       16
+#define LINK_TIMEOUT_MIN_SAMPLES    4
+#define LINK_TIMEOUT_MAX_BACKOFF    4  // up to 16x the learned window
+#define LINK_ACK_MIN_SAMPLES        1  // the handshake is rare but its timing steady
+
+struct ReplyTimeouts {
+  uint16_t firstByteMs;
+  uint16_t replyMs;
+};
+
+ReplyTimeouts linkTimeoutsFor(uint32_t opKey);
+void linkTimeoutsSample(uint32_t opKey, uint32_t firstByteUs, uint32_t replyUs);
+void linkTimeoutsMissed(uint32_t opKey);
+
+uint16_t linkAckTimeout();
+void linkAckSample(uint32_t us);
+void linkAckMissed();
+
+#endif // LINK_TIMEOUTS_H
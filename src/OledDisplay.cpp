@@ -17,16 +17,18 @@ const unsigned char wifi_bmp [] PROGMEM = {
 // OLED Display object
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
 
-// Initialize the OLED display
-void initOledDisplay() {
+// Initialize the OLED display, false if there is none. The bridge
+// carries on without it.
+bool initOledDisplay() {
     if(!display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
         Serial.println(F("SSD1306 allocation failed"));
-        for(;;); // Don't proceed, loop forever
+        return false;
     }
     
     display.clearDisplay();
     display.setTextColor(WHITE); // need this
     display.display();
+    return true;
 }
 
 void printCentered(Adafruit_SSD1306 &display, const char *text, int y) {
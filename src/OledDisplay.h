@@ -6,7 +6,7 @@
 #include <IPAddress.h>
 
 // Function prototypes
-void initOledDisplay();
+bool initOledDisplay();
 void updateOledDisplay(IPAddress lxStaIpMsg, IPAddress lxApIpMsg, String wdStaIpMsg, IPAddress wdApIpMsg);
 
 #endif // OLED_DISPLAY_H
@@ -0,0 +1,67 @@
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include "PositionBroadcast.h"
+#include "BridgeConfig.h"
+#include "TelemetryPrefetch.h"
+
+#define BROADCAST_LEN      24
+#define BROADCAST_VERSION   1
+
+#define FLAG_RADEC    0x01
+#define FLAG_ALTAZ    0x02
+#define FLAG_SLEWING  0x04
+
+static WiFiUDP broadcastUdp;
+static unsigned long lastSent = 0;
+static uint16_t seq = 0;
+static bool listeners = false;
+static const unsigned long period = POSITION_BROADCAST_MS;  // 0 if off
+
+static void putLe(uint8_t *p, uint32_t v, uint8_t bytes) {
+  for (uint8_t i = 0; i < bytes; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void sendTo(IPAddress ip, const uint8_t *buf) {
+  broadcastUdp.beginPacket(ip, BROADCAST_PORT);
+  broadcastUdp.write(buf, BROADCAST_LEN);
+  broadcastUdp.endPacket();
+}
+
+void broadcastBegin() {
+  lastSent = millis();
+}
+
+bool broadcastActive() {
+  return listeners;
+}
+
+// ============== Broadcast Service =======================
+// Returns true if it sent anything.
+bool broadcastService() {
+  if (period == 0) return false;
+  unsigned long now = millis();
+  if (now - lastSent < period) return false;
+  lastSent = now;
+
+  bool sta = WiFi.status() == WL_CONNECTED;
+  listeners = sta || WiFi.softAPgetStationNum() > 0;
+  if (!listeners) return false;
+
+  uint8_t buf[BROADCAST_LEN] = { 'L', 'X', 'P', 'S', BROADCAST_VERSION };
+  PrefetchPosition pos;
+  if (prefetchPosition(pos)) {
+    buf[5] = FLAG_RADEC | (pos.hasAltAz ? FLAG_ALTAZ : 0) | (pos.slewing ? FLAG_SLEWING : 0);
+    putLe(buf + 8, pos.ra, 4);
+    putLe(buf + 12, (uint32_t)pos.dec, 4);
+    putLe(buf + 16, (uint32_t)pos.alt, 4);
+    putLe(buf + 20, pos.az, 4);
+  }
+  putLe(buf + 6, seq++, 2);
+
+  // The two networks can share a subnet, send once then
+  IPAddress ap = WiFi.softAPBroadcastIP();
+  IPAddress home = WiFi.broadcastIP();
+  sendTo(ap, buf);
+  if (sta && !(home == ap)) sendTo(home, buf);
+  return true;
+}
@@ -0,0 +1,34 @@
+#ifndef POSITION_BROADCAST_H
+#define POSITION_BROADCAST_H
+
+#include <Arduino.h>
+
+#define BROADCAST_PORT  10002  // UDP
+
+// Position datagram broadcast on the AP and, once joined, the home network
+// every POSITION_BROADCAST_MS if that is set (off by default), for passive
+// viewers such as phones showing where the scope points on a public night.
+// Any number can listen on the home network; on the AP they share its
+// LX200_AP_MAX_STATIONS with the apps. It is built from the telemetry
+// prefetcher's cache, so listeners cost no UART traffic.
+// 24 bytes, little-endian:
+//
+//    0  "LXPS"
+//    4  version, 1
+//    5  flags    bit 0 RA/Dec valid, bit 1 Alt/Az valid, bit 2 slewing
+//    6  seq u16  counts datagrams, a gap is a lost one
+//    8  RA  u32  0x100000000 = 24h
+//   12  Dec s32  0x40000000 = 90 degrees
+//   16  Alt s32  0x40000000 = 90 degrees
+//   20  Az  u32  0x100000000 = 360 degrees
+//
+// Without a current position the datagram still goes out, flags 0.
+
+void broadcastBegin();
+bool broadcastService();
+
+// The broadcast is on and somebody may be listening: a station is on the
+// AP or the home network is joined. The prefetcher keeps polling while it is.
+bool broadcastActive();
+
+#endif // POSITION_BROADCAST_H
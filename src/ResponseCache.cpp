@@ -0,0 +1,120 @@
+#include "ResponseCache.h"
+#include "BridgeConfig.h"
+#include "LX200Commands.h"
+
+#define TTL_FOREVER 0xFFFFFFFFUL
+
+struct CacheEntry {
+  char cmd[CACHE_KEY_MAX];
+  char resp[CACHE_RESP_MAX];
+  uint8_t len;
+  unsigned long storedAt;
+  bool valid;
+  bool filling;
+  uint32_t fillGeneration;  // generation when the fill was requested
+};
+
+static CacheEntry entries[CACHE_ENTRIES];
+static uint32_t generation = 0;  // bumped on every invalidation
+static unsigned long positionTtl = CACHE_POSITION_TTL_MS;
+
+// How long a reply may be reused, 0 if not at all
+static unsigned long ttlFor(const char *cmd) {
+  switch (lx200Lookup(cmd).cache) {
+    case LX200_CACHE_POSITION: return positionTtl;
+    case LX200_CACHE_SETTING:  return TTL_FOREVER;
+    default:                   return 0;
+  }
+}
+
+static CacheEntry *findEntry(const char *cmd) {
+  for (uint8_t i = 0; i < CACHE_ENTRIES; i++) {
+    if ((entries[i].valid || entries[i].filling) && strcmp(entries[i].cmd, cmd) == 0) return &entries[i];
+  }
+  return nullptr;
+}
+
+// Find the entry for cmd or claim a free (or the oldest) one
+static CacheEntry *claimEntry(const char *cmd) {
+  CacheEntry *e = findEntry(cmd);
+  if (e != nullptr) return e;
+
+  CacheEntry *victim = nullptr;
+  for (uint8_t i = 0; i < CACHE_ENTRIES; i++) {
+    CacheEntry &c = entries[i];
+    if (c.filling) continue;
+    if (!c.valid) { victim = &c; break; }
+    if (victim == nullptr || (long)(c.storedAt - victim->storedAt) < 0) victim = &c;
+  }
+  if (victim == nullptr) return nullptr;
+
+  strlcpy(victim->cmd, cmd, sizeof(victim->cmd));
+  victim->valid = false;
+  victim->filling = false;
+  return victim;
+}
+
+void cacheBegin() {
+  for (uint8_t i = 0; i < CACHE_ENTRIES; i++) {
+    entries[i].valid = false;
+    entries[i].filling = false;
+  }
+}
+
+void cacheSetPositionTtl(unsigned long ms) {
+  positionTtl = ms;
+}
+
+// Clear the cache, e.g. the mount moved or a setting changed. A fill
+// already on its way still answers the client that asked for it, but it
+// is not kept.
+void cacheInvalidate() {
+  generation++;
+  for (uint8_t i = 0; i < CACHE_ENTRIES; i++) entries[i].valid = false;
+}
+
+uint8_t cacheLookup(const char *cmd, char *resp) {
+  CacheEntry *e = findEntry(cmd);
+  if (e == nullptr || !e->valid) return 0;
+
+  unsigned long ttl = ttlFor(cmd);
+  if (ttl != TTL_FOREVER && millis() - e->storedAt >= ttl) {
+    e->valid = false;
+    return 0;
+  }
+  memcpy(resp, e->resp, e->len + 1);
+  return e->len;
+}
+
+void cacheMarkFilling(const char *cmd) {
+  CacheEntry *e = claimEntry(cmd);
+  if (e == nullptr) return;
+  e->filling = true;
+  e->fillGeneration = generation;
+}
+
+bool cacheFilling(const char *cmd) {
+  CacheEntry *e = findEntry(cmd);
+  return e != nullptr && e->filling;
+}
+
+// Keep a complete reply, unless the cache was cleared since it was requested
+void cacheStore(const char *cmd, const char *resp, uint8_t len) {
+  CacheEntry *e = findEntry(cmd);
+  if (e == nullptr || !e->filling) return;
+  e->filling = false;
+
+  if (e->fillGeneration != generation) return;
+  if (len == 0 || len >= CACHE_RESP_MAX || resp[len - 1] != '#') return;
+
+  memcpy(e->resp, resp, len);
+  e->resp[len] = '\0';
+  e->len = len;
+  e->storedAt = millis();
+  e->valid = true;
+}
+
+void cacheAbort(const char *cmd) {
+  CacheEntry *e = findEntry(cmd);
+  if (e != nullptr) e->filling = false;
+}
@@ -0,0 +1,33 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <Arduino.h>
+
+// Read-through cache of Teensy replies keyed on the command string.
+// Which commands are cached is set in the LX200Commands table: position
+// and status polls are reused for CACHE_POSITION_TTL_MS, site settings
+// until changed. Any command that moves the mount or sets something
+// (:M*, :Q*, :CM#, :CS#, :S*, ...) clears the whole cache.
+
+#define CACHE_ENTRIES       12
+#define CACHE_KEY_MAX        8   // longest cacheable command, e.g. ":GVP#"
+#define CACHE_RESP_MAX      32
+
+void cacheBegin();
+void cacheInvalidate();
+
+// The prefetcher refreshes position polls on its own schedule and
+// stretches their TTL to match, see TelemetryPrefetch.h
+void cacheSetPositionTtl(unsigned long ms);
+// Copies a cached reply into resp (LX200_REPLY_MAX_LEN + 1 bytes) and
+// returns its length, 0 if there is none
+uint8_t cacheLookup(const char *cmd, char *resp);
+
+// A reply for cmd is on its way from the Teensy. Other polls for the same
+// command can wait for it rather than going to the Teensy themselves.
+void cacheMarkFilling(const char *cmd);
+bool cacheFilling(const char *cmd);
+void cacheStore(const char *cmd, const char *resp, uint8_t len);
+void cacheAbort(const char *cmd);
+
+#endif // RESPONSE_CACHE_H
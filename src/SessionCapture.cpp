@@ -0,0 +1,135 @@
+#include "SessionCapture.h"
+
+// Records are packed back to back in a byte ring:
+//   dir, peer, len, micros() (4 bytes, little endian), len bytes
+// head and tail run freely, the ring index is taken modulo its size.
+#define CAP_HEADER      7
+#define CAP_NONE        0xFFFFFFFFUL
+#define CAP_LINE_BYTES  24  // raw bytes per dump line, at most 4 chars each
+
+static_assert((CAPTURE_BUF_BYTES & (CAPTURE_BUF_BYTES - 1)) == 0, "CAPTURE_BUF_BYTES must be a power of two");
+
+static uint8_t ring[CAPTURE_BUF_BYTES];
+static uint32_t head = 0;          // next byte to write
+static uint32_t tail = 0;          // oldest record
+static uint32_t openRec = CAP_NONE;  // record that may still grow
+static uint32_t dropped = 0;
+
+static bool dumping = false;
+static bool dumpHeader = false;
+static uint32_t dumpEnd = 0;       // head when the dump was asked for
+static uint8_t dumpOffset = 0;     // bytes of the tail record already printed
+
+static uint8_t at(uint32_t pos) {
+  return ring[pos % CAPTURE_BUF_BYTES];
+}
+
+static void put(uint32_t pos, uint8_t b) {
+  ring[pos % CAPTURE_BUF_BYTES] = b;
+}
+
+static uint32_t recordTime(uint32_t pos) {
+  return (uint32_t)at(pos + 3) | (uint32_t)at(pos + 4) << 8 |
+         (uint32_t)at(pos + 5) << 16 | (uint32_t)at(pos + 6) << 24;
+}
+
+// Drop the oldest records until n more bytes fit
+static void makeRoom(uint32_t n) {
+  while (CAPTURE_BUF_BYTES - (head - tail) < n) {
+    if (tail == openRec) openRec = CAP_NONE;
+    tail += CAP_HEADER + at(tail + 2);
+    dumpOffset = 0;
+    dropped++;
+  }
+}
+
+void captureRecord(CaptureDir dir, uint8_t peer, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  uint32_t now = micros();
+
+  // Bytes that continue the previous record, e.g. a reply read a byte at a time
+  if (openRec != CAP_NONE && at(openRec) == dir && at(openRec + 1) == peer &&
+      now - recordTime(openRec) < CAPTURE_MERGE_US) {
+    size_t room = 255 - at(openRec + 2);
+    size_t n = len < room ? len : room;
+    makeRoom(n);
+    if (openRec != CAP_NONE) {
+      for (size_t i = 0; i < n; i++) put(head++, p[i]);
+      put(openRec + 2, at(openRec + 2) + n);
+      p += n;
+      len -= n;
+      if (len == 0) return;
+    }
+  }
+
+  do {
+    uint8_t n = len < 255 ? (uint8_t)len : 255;
+    makeRoom(CAP_HEADER + n);
+    openRec = head;
+    put(head++, dir);
+    put(head++, peer);
+    put(head++, n);
+    for (uint8_t i = 0; i < 4; i++) put(head++, (uint8_t)(now >> (8 * i)));
+    for (uint8_t i = 0; i < n; i++) put(head++, p[i]);
+    p += n;
+    len -= n;
+  } while (len > 0);
+}
+
+// Start dumping what has been captured so far
+void captureDump() {
+  dumping = true;
+  dumpHeader = true;
+  dumpEnd = head;
+}
+
+// Print up to maxLines of the dump, consuming the records. Returns true
+// if anything was written.
+bool captureDrain(Print &out, uint8_t maxLines) {
+  if (!dumping) return false;
+
+  if (dumpHeader) {
+    dumpHeader = false;
+    out.println("# lx200 capture 1");
+    if (dropped != 0) out.printf("# %lu older records dropped\n", (unsigned long)dropped);
+    return true;
+  }
+
+  static const char dirChar[] = { '>', '<', '<', '>', '+', '-' };
+  uint8_t lines = 0;
+  while (lines < maxLines && (int32_t)(dumpEnd - tail) > 0) {
+    uint8_t dir = at(tail);
+    uint8_t peer = at(tail + 1);
+    uint8_t len = at(tail + 2);
+    if (tail == openRec) openRec = CAP_NONE;  // printed, don't grow it
+
+    char line[24 + CAP_LINE_BYTES * 4 + 2];
+    int pos = snprintf(line, sizeof(line), "%lu %c", (unsigned long)recordTime(tail),
+                       dir < sizeof(dirChar) ? dirChar[dir] : '?');
+    if (dir == CAP_TEENSY_OUT || dir == CAP_TEENSY_IN) pos += snprintf(line + pos, sizeof(line) - pos, "T ");
+    else pos += snprintf(line + pos, sizeof(line) - pos, "C%u ", peer);
+
+    uint8_t end = len - dumpOffset > CAP_LINE_BYTES ? dumpOffset + CAP_LINE_BYTES : len;
+    for (uint8_t i = dumpOffset; i < end; i++) {
+      uint8_t b = at(tail + CAP_HEADER + i);
+      if (b > ' ' && b < 0x7F && b != '\\') line[pos++] = (char)b;
+      else pos += snprintf(line + pos, sizeof(line) - pos, "\\x%02X", b);
+    }
+    line[pos] = '\0';
+    out.println(line);
+    lines++;
+
+    dumpOffset = end;
+    if (dumpOffset >= len) {
+      tail += CAP_HEADER + len;
+      dumpOffset = 0;
+    }
+  }
+
+  if ((int32_t)(dumpEnd - tail) <= 0) {
+    dumping = false;
+    dropped = 0;
+    out.println("# end");
+  }
+  return true;
+}
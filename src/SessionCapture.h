@@ -0,0 +1,45 @@
+#ifndef SESSION_CAPTURE_H
+#define SESSION_CAPTURE_H
+
+#include <Arduino.h>
+#include "BridgeConfig.h"
+
+// Capture of the raw traffic in both directions, client <-> bridge and
+// bridge <-> Teensy, so a field session can be replayed against the native
+// build (tools/lx200_replay.py). Recording copies the bytes into a ring with
+// a micros() timestamp, bytes that continue the previous record are
+// appended to it. When the ring is full the oldest records are dropped, so
+// it always holds the latest CAPTURE_BUF_BYTES of traffic.
+//
+// Type 'c' on the debug console to dump it. The dump is drained from
+// loop() like the trace, one line per chunk of a record:
+//
+//   # lx200 capture 1
+//   <micros> <dir><peer> <bytes>
+//
+// dir is '>' into the bridge, '<' out of it, '+'/'-' connect/disconnect.
+// peer is 'C' and the client slot, or 'T' for the Teensy. Bytes outside
+// printable ASCII, space and '\' are written as \xNN.
+
+#define CAPTURE_MERGE_US  1000  // append to the previous record within this
+
+enum CaptureDir : uint8_t {
+  CAP_CLIENT_IN,     // client -> bridge
+  CAP_CLIENT_OUT,    // bridge -> client
+  CAP_TEENSY_OUT,    // bridge -> Teensy
+  CAP_TEENSY_IN,     // Teensy -> bridge
+  CAP_CONNECT,       // client connected
+  CAP_DISCONNECT     // client dropped
+};
+
+void captureRecord(CaptureDir dir, uint8_t peer, const void *data, size_t len);
+void captureDump();
+bool captureDrain(Print &out, uint8_t maxLines);
+
+#if BRIDGE_CAPTURE
+#define CAPTURE(dir, peer, data, len) captureRecord(dir, peer, data, len)
+#else
+#define CAPTURE(dir, peer, data, len) do {} while (0)
+#endif
+
+#endif // SESSION_CAPTURE_H
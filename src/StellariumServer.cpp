@@ -0,0 +1,261 @@
+#include <lwip/sockets.h>
+#include "StellariumServer.h"
+#include "BridgeConfig.h"
+#include "TeensyLink.h"
+#include "ResponseCache.h"
+#include "LX200Commands.h"
+#include "TelemetryPrefetch.h"
+
+#define STEL_MSG_GOTO       0
+#define STEL_GOTO_LEN      20
+#define STEL_POSITION_LEN  24
+#define STEL_RX_MAX        32  // longest message taken, anything longer is a broken client
+
+#define STEL_RA_SECONDS    86400   // seconds of time in 0x100000000
+#define STEL_DEC_ARCSEC    324000  // arcseconds in 0x40000000, as in PrefetchPosition
+
+WiFiServer stellariumServer(STELLARIUM_PORT);
+
+// Where a client's goto is on the link
+enum StelGotoStep : uint8_t {
+  STEL_GOTO_IDLE,
+  STEL_GOTO_TARGET,  // :Sr and :Sd submitted
+  STEL_GOTO_SLEW     // :MS# submitted
+};
+
+enum { STEL_SR, STEL_SD, STEL_MS, STEL_GOTO_CMDS };
+
+struct StelConn {
+  WiFiClient client;
+  bool active;
+  uint8_t rxBuf[STEL_RX_MAX];
+  uint8_t rxLen;
+  uint8_t txBuf[STEL_POSITION_LEN];
+  uint8_t txLen;          // position still to be sent
+  unsigned long lastPush;
+  StelGotoStep step;
+  uint32_t ra;            // target of the goto in progress
+  int32_t dec;
+  bool nextQueued;        // a newer goto waits for this one to finish
+  uint32_t nextRa;
+  int32_t nextDec;
+  TeensyTicket tickets[STEL_GOTO_CMDS];
+  char replies[STEL_GOTO_CMDS][LX200_REPLY_MAX_LEN + 1];
+};
+
+static StelConn stelConns[STELLARIUM_MAX_CLIENTS];
+
+// Stellarium only uses the time to order positions, bridge uptime will do
+static uint64_t uptimeMicros() {
+  static uint64_t total = 0;
+  static uint32_t last = 0;
+  uint32_t now = micros();
+  total += (uint32_t)(now - last);
+  last = now;
+  return total;
+}
+
+// ============== Coordinates =============================
+// The goto target as :Sr or :Sd, to the nearest second
+static void formatTarget(const StelConn &c, uint8_t which, char *cmd) {
+  if (which == STEL_SR) {
+    uint32_t secs = (uint32_t)(((uint64_t)c.ra * STEL_RA_SECONDS + (1ull << 31)) >> 32) % STEL_RA_SECONDS;
+    snprintf(cmd, LX200_CMD_MAX_LEN + 1, ":Sr%02u:%02u:%02u#",
+             (unsigned)(secs / 3600), (unsigned)(secs / 60 % 60), (unsigned)(secs % 60));
+  } else {
+    int64_t arcsec = ((int64_t)c.dec * STEL_DEC_ARCSEC + (1 << 29)) >> 30;
+    uint32_t a = (uint32_t)(arcsec < 0 ? -arcsec : arcsec);
+    if (a > STEL_DEC_ARCSEC) a = STEL_DEC_ARCSEC;
+    snprintf(cmd, LX200_CMD_MAX_LEN + 1, ":Sd%c%02u*%02u:%02u#", arcsec < 0 ? '-' : '+',
+             (unsigned)(a / 3600), (unsigned)(a / 60 % 60), (unsigned)(a % 60));
+  }
+}
+
+static uint32_t getLe(const uint8_t *p, uint8_t bytes) {
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < bytes; i++) v |= (uint32_t)p[i] << (8 * i);
+  return v;
+}
+
+static void putLe(uint8_t *p, uint64_t v, uint8_t bytes) {
+  for (uint8_t i = 0; i < bytes; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+// ============== Goto ====================================
+// The target sets go to the link together and :MS# only once both are
+// taken, so a refused coordinate never slews to the previous target.
+// Returns true if it did any work.
+static bool serviceGoto(StelConn &c) {
+  int client = (int)(&c - stelConns);
+  char cmd[LX200_CMD_MAX_LEN + 1];
+
+  switch (c.step) {
+    case STEL_GOTO_IDLE:
+      if (!c.nextQueued) return false;
+      c.ra = c.nextRa;
+      c.dec = c.nextDec;
+      c.nextQueued = false;
+      c.step = STEL_GOTO_TARGET;
+      // fall through
+
+    case STEL_GOTO_TARGET: {
+      for (uint8_t i = STEL_SR; i <= STEL_SD; i++) {
+        if (c.tickets[i] != TEENSY_NO_TICKET) continue;
+        formatTarget(c, i, cmd);
+        c.tickets[i] = teensySubmit(cmd, c.replies[i], LX200_SHAPE_CHAR);
+        if (c.tickets[i] == TEENSY_NO_TICKET) return true;  // link full, next pass
+      }
+      if (!teensyDone(c.tickets[STEL_SR]) || !teensyDone(c.tickets[STEL_SD])) return false;
+
+      bool taken = true;
+      for (uint8_t i = STEL_SR; i <= STEL_SD; i++) {
+        teensyTakeResponse(c.tickets[i]);
+        c.tickets[i] = TEENSY_NO_TICKET;
+        taken &= c.replies[i][0] == '1';
+      }
+      cacheInvalidate();
+      if (!taken) {
+        SERIAL_DEBUG.printf("[Stellarium] Client %d: Teensy rejected the target\n", client);
+        c.step = STEL_GOTO_IDLE;
+        return true;
+      }
+      c.step = STEL_GOTO_SLEW;
+    }
+      // fall through
+
+    case STEL_GOTO_SLEW:
+      if (c.tickets[STEL_MS] == TEENSY_NO_TICKET) {
+        c.tickets[STEL_MS] = teensySubmit(":MS#", c.replies[STEL_MS], LX200_SHAPE_CHAR);
+        return true;
+      }
+      if (!teensyDone(c.tickets[STEL_MS])) return false;
+      teensyTakeResponse(c.tickets[STEL_MS]);
+      c.tickets[STEL_MS] = TEENSY_NO_TICKET;
+      cacheInvalidate();
+      prefetchNoteMotion(LX200_MOTION_START);
+      if (c.replies[STEL_MS][0] != '0') {
+        SERIAL_DEBUG.printf("[Stellarium] Client %d: goto refused (%s)\n", client, c.replies[STEL_MS]);
+      }
+      c.step = STEL_GOTO_IDLE;
+      return true;
+  }
+  return false;
+}
+
+// ============== Client I/O ==============================
+// Take the messages a client has sent. Only gotos are defined, anything
+// else of a sane length is skipped. Returns false if the client is broken.
+static bool readStellariumClient(StelConn &c, bool &busy) {
+  for (;;) {
+    int n = c.client.read(c.rxBuf + c.rxLen, sizeof(c.rxBuf) - c.rxLen);
+    if (n <= 0) return true;
+    c.rxLen += n;
+    busy = true;
+
+    while (c.rxLen >= 4) {
+      uint16_t len = getLe(c.rxBuf, 2);
+      if (len < 4 || len > STEL_RX_MAX) return false;
+      if (c.rxLen < len) break;
+
+      if (len == STEL_GOTO_LEN && getLe(c.rxBuf + 2, 2) == STEL_MSG_GOTO) {
+        c.nextRa = getLe(c.rxBuf + 12, 4);
+        c.nextDec = (int32_t)getLe(c.rxBuf + 16, 4);
+        c.nextQueued = true;  // only the latest target matters
+      }
+      c.rxLen -= len;
+      memmove(c.rxBuf, c.rxBuf + len, c.rxLen);
+    }
+  }
+}
+
+// Push the position at the configured rate. A push the socket hasn't
+// taken yet is finished first, a newer position simply waits its turn.
+static bool writeStellariumClient(StelConn &c) {
+  bool busy = false;
+  unsigned long now = millis();
+  PrefetchPosition pos;
+
+  if (c.txLen == 0 && now - c.lastPush >= STELLARIUM_PUSH_MS && prefetchPosition(pos)) {
+    putLe(c.txBuf, STEL_POSITION_LEN, 2);
+    putLe(c.txBuf + 2, STEL_MSG_GOTO, 2);
+    putLe(c.txBuf + 4, uptimeMicros(), 8);
+    putLe(c.txBuf + 12, pos.ra, 4);
+    putLe(c.txBuf + 16, (uint32_t)pos.dec, 4);
+    putLe(c.txBuf + 20, 0, 4);  // status ok
+    c.txLen = STEL_POSITION_LEN;
+    c.lastPush = now;
+  }
+
+  if (c.txLen > 0) {
+    uint8_t off = STEL_POSITION_LEN - c.txLen;
+    int n = send(c.client.fd(), c.txBuf + off, c.txLen, MSG_DONTWAIT);
+    if (n > 0) {
+      c.txLen -= n;
+      busy = true;
+    }
+  }
+  return busy;
+}
+
+static void dropStellariumClient(StelConn &c) {
+  for (uint8_t i = 0; i < STEL_GOTO_CMDS; i++) teensyRelease(c.tickets[i]);
+  c.client.stop();
+  c.active = false;
+  SERIAL_DEBUG.printf("[Stellarium] Client %d disconnected\n", (int)(&c - stelConns));
+}
+
+static bool acceptStellariumClient() {
+  WiFiClient client = stellariumServer.available();
+  if (!client || !client.connected()) return false;
+
+  for (uint8_t i = 0; i < STELLARIUM_MAX_CLIENTS; i++) {
+    StelConn &c = stelConns[i];
+    if (c.active) continue;
+    c.client = client;
+    c.client.setNoDelay(true);
+    c.rxLen = c.txLen = 0;
+    c.lastPush = millis() - STELLARIUM_PUSH_MS;  // first position as soon as there is one
+    c.step = STEL_GOTO_IDLE;
+    c.nextQueued = false;
+    for (uint8_t t = 0; t < STEL_GOTO_CMDS; t++) c.tickets[t] = TEENSY_NO_TICKET;
+    c.active = true;
+    SERIAL_DEBUG.printf("[Stellarium] Client %d connected\n", i);
+    return true;
+  }
+
+  SERIAL_DEBUG.println("[Stellarium] No free client slot, connection refused");
+  client.stop();
+  return true;
+}
+
+void stellariumServerBegin() {
+  for (uint8_t i = 0; i < STELLARIUM_MAX_CLIENTS; i++) stelConns[i].active = false;
+  stellariumServer.begin();
+}
+
+uint8_t stellariumClientCount() {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < STELLARIUM_MAX_CLIENTS; i++) n += stelConns[i].active;
+  return n;
+}
+
+// ============== Handle Stellarium Clients ===============
+// Service every client connection without blocking. Returns true if
+// anything happened.
+bool handleStellariumClients() {
+  bool busy = acceptStellariumClient();
+
+  for (uint8_t i = 0; i < STELLARIUM_MAX_CLIENTS; i++) {
+    StelConn &c = stelConns[i];
+    if (!c.active) continue;
+
+    if (!c.client.connected() || !readStellariumClient(c, busy)) {
+      dropStellariumClient(c);
+      busy = true;
+      continue;
+    }
+    busy |= serviceGoto(c);
+    busy |= writeStellariumClient(c);
+  }
+  return busy;
+}
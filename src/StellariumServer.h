@@ -0,0 +1,32 @@
+#ifndef STELLARIUM_SERVER_H
+#define STELLARIUM_SERVER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#define STELLARIUM_PORT        10001  // Stellarium's default for a remote telescope
+#define STELLARIUM_MAX_CLIENTS     2
+
+// Server for the binary protocol of desktop Stellarium's "Telescope
+// Control" plugin (telescope controlled remotely, "Stellarium, directly
+// connected" server type). Messages are little-endian, led by their
+// length and a type of 0:
+//
+//   goto      client -> bridge, 20 bytes
+//             len u16, type u16, time u64, RA u32, Dec s32
+//   position  bridge -> client, 24 bytes
+//             len u16, type u16, time u64, RA u32, Dec s32, status s32
+//
+// RA is 0x100000000 to a full 24h, Dec 0x40000000 to 90 degrees, time is
+// in microseconds. The plugin defaults to J2000 but OnStepX works in JNow,
+// and nothing is precessed here: the telescope must be set to "JNow" in
+// Stellarium. Positions are pushed every STELLARIUM_PUSH_MS from the
+// response cache the telemetry prefetcher keeps filled, so these clients
+// never poll the Teensy. A goto becomes :Sr, :Sd and, if both are taken,
+// :MS# on the Teensy link.
+
+void stellariumServerBegin();
+bool handleStellariumClients();
+uint8_t stellariumClientCount();
+
+#endif // STELLARIUM_SERVER_H
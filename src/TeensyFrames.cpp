@@ -0,0 +1,237 @@
+#include "TeensyFrames.h"
+#include "LX200Commands.h"
+
+// How an argument or reply is packed
+enum FramePack : uint8_t {
+  PACK_TEXT,  // as is
+  PACK_HMS,   // "HH:MM:SS"  -> H, M, S
+  PACK_DMS,   // "sDD*MM:SS" -> D | 0x80 if negative, M, S
+  PACK_DDD    // "DDD*MM:SS" -> D >> 8, D & 0xFF, M, S
+};
+
+struct FrameOp {
+  const char *op;
+  FramePack args;
+  FramePack reply;
+};
+
+// Opcode byte = index + 1. Shared with the LX200Handler, so only ever
+// append to it.
+static const FrameOp frameOps[] = {
+  { "GR", PACK_TEXT, PACK_HMS },
+  { "GD", PACK_TEXT, PACK_DMS },
+  { "GA", PACK_TEXT, PACK_DMS },
+  { "GZ", PACK_TEXT, PACK_DDD },
+  { "GS", PACK_TEXT, PACK_HMS },
+  { "GL", PACK_TEXT, PACK_HMS },
+  { "GW", PACK_TEXT, PACK_TEXT },
+  { "GU", PACK_TEXT, PACK_TEXT },
+  { "D",  PACK_TEXT, PACK_TEXT },
+  { "Sr", PACK_HMS,  PACK_TEXT },
+  { "Sd", PACK_DMS,  PACK_TEXT },
+  { "MS", PACK_TEXT, PACK_TEXT },
+  { "Q",  PACK_TEXT, PACK_TEXT },
+};
+
+#define FRAME_OPS (sizeof(frameOps) / sizeof(frameOps[0]))
+
+uint16_t frameCrc16(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t b = 0; b < 8; b++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// ============== Packing =================================
+static bool twoDigits(const char *s, uint8_t &v) {
+  if (!isdigit((uint8_t)s[0]) || !isdigit((uint8_t)s[1])) return false;
+  v = (s[0] - '0') * 10 + (s[1] - '0');
+  return true;
+}
+
+// ":MM:SS" style tail shared by all three formats
+static bool packMinSec(const char *s, char sep, uint8_t *out) {
+  return s[0] == sep && twoDigits(s + 1, out[0]) && s[3] == ':' && twoDigits(s + 4, out[1]);
+}
+
+// Packs text of exactly len characters, returns the packed size or 0
+static uint8_t pack(FramePack how, const char *s, size_t len, uint8_t *out) {
+  switch (how) {
+    case PACK_HMS:
+      if (len != 8 || !twoDigits(s, out[0]) || !packMinSec(s + 2, ':', out + 1)) return 0;
+      return 3;
+    case PACK_DMS:
+      if (len != 9 || (s[0] != '+' && s[0] != '-') || !twoDigits(s + 1, out[0]) || !packMinSec(s + 3, '*', out + 1)) return 0;
+      if (s[0] == '-') out[0] |= 0x80;
+      return 3;
+    case PACK_DDD: {
+      if (len != 9 || !isdigit((uint8_t)s[0]) || !twoDigits(s + 1, out[1]) || !packMinSec(s + 3, '*', out + 2)) return 0;
+      uint16_t deg = (s[0] - '0') * 100 + out[1];
+      out[0] = deg >> 8;
+      out[1] = deg & 0xFF;
+      return 4;
+    }
+    default:
+      return 0;
+  }
+}
+
+// Unpacks into out (at least 10 bytes), returns the text length or 0
+static uint8_t unpack(FramePack how, const uint8_t *p, uint8_t len, char *out) {
+  switch (how) {
+    case PACK_HMS:
+      if (len != 3) return 0;
+      return snprintf(out, 10, "%02u:%02u:%02u", p[0], p[1], p[2]);
+    case PACK_DMS:
+      if (len != 3) return 0;
+      return snprintf(out, 11, "%c%02u*%02u:%02u", (p[0] & 0x80) ? '-' : '+', p[0] & 0x7F, p[1], p[2]);
+    case PACK_DDD:
+      if (len != 4) return 0;
+      return snprintf(out, 11, "%03u*%02u:%02u", (unsigned)(p[0] << 8 | p[1]), p[2], p[3]);
+    default:
+      return 0;
+  }
+}
+
+// Table entry for a ":...#" command and where its arguments start
+static const FrameOp *findOp(const char *cmd, const char **args, size_t *argLen) {
+  uint32_t key = lx200CmdKey(cmd);
+  for (uint8_t i = 0; i < FRAME_OPS; i++) {
+    if (lx200OpKey(frameOps[i].op) != key) continue;
+    const char *hash = strchr(cmd, '#');
+    *args = cmd + 1 + strlen(frameOps[i].op);
+    *argLen = hash != nullptr && hash >= *args ? (size_t)(hash - *args) : 0;
+    return &frameOps[i];
+  }
+  return nullptr;
+}
+
+static size_t finishFrame(uint8_t head, uint8_t *out, uint8_t len) {
+  out[0] = head;
+  out[1] = len;
+  uint16_t crc = frameCrc16(out, len + 2);
+  out[len + 2] = crc >> 8;
+  out[len + 3] = crc & 0xFF;
+  return len + FRAME_OVERHEAD;
+}
+
+// ============== Bridge Side =============================
+// Frame a ":...#" command into out (FRAME_MAX_LEN bytes), returns its length
+size_t frameEncodeCommand(const char *cmd, uint8_t seq, uint8_t *out) {
+  uint8_t *p = out + 2;
+  const char *args;
+  size_t argLen;
+  const FrameOp *op = findOp(cmd, &args, &argLen);
+  uint8_t len = 0;
+
+  if (op != nullptr) {
+    p[0] = (uint8_t)(op - frameOps) + 1;
+    if (op->args == PACK_TEXT) {
+      if (argLen < FRAME_MAX_PAYLOAD) {
+        memcpy(p + 1, args, argLen);
+        len = 1 + argLen;
+      }
+    } else {
+      uint8_t n = pack(op->args, args, argLen, p + 1);
+      if (n != 0) len = 1 + n;
+    }
+  }
+
+  // Not in the table or not in the expected format: the body as text
+  if (len == 0) {
+    const char *body = cmd + 1;
+    const char *hash = strchr(body, '#');
+    size_t n = hash != nullptr ? (size_t)(hash - body) : strlen(body);
+    if (n > FRAME_MAX_PAYLOAD - 1) n = FRAME_MAX_PAYLOAD - 1;
+    p[0] = 0;
+    memcpy(p + 1, body, n);
+    len = 1 + n;
+  }
+  return finishFrame(FRAME_HEAD | (seq & FRAME_SEQ_MASK), out, len);
+}
+
+// LX200 text of a reply frame to cmd, NUL terminated. Returns its length,
+// 0 if a packed payload doesn't fit the format.
+uint8_t frameDecodeReply(const char *cmd, bool packed, const uint8_t *payload, uint8_t len, char *reply, uint8_t cap) {
+  if (!packed) {
+    if (len > cap) len = cap;
+    memcpy(reply, payload, len);
+    reply[len] = '\0';
+    return len;
+  }
+
+  const char *args;
+  size_t argLen;
+  const FrameOp *op = findOp(cmd, &args, &argLen);
+  char text[12];
+  uint8_t n = op != nullptr ? unpack(op->reply, payload, len, text) : 0;
+  if (n == 0 || n + 1 > cap) return 0;
+  memcpy(reply, text, n);
+  reply[n++] = '#';
+  reply[n] = '\0';
+  return n;
+}
+
+// ============== Teensy Side =============================
+// LX200 text of a command frame, NUL terminated
+bool frameDecodeCommand(const uint8_t *payload, uint8_t len, char *cmd, size_t cap) {
+  if (len == 0 || payload[0] > FRAME_OPS) return false;
+  size_t n = 0;
+  cmd[n++] = ':';
+  if (payload[0] != 0) {
+    const FrameOp &op = frameOps[payload[0] - 1];
+    size_t opLen = strlen(op.op);
+    memcpy(cmd + n, op.op, opLen);
+    n += opLen;
+    if (op.args != PACK_TEXT) {
+      char text[12];
+      uint8_t t = unpack(op.args, payload + 1, len - 1, text);
+      if (t == 0 || n + t + 2 > cap) return false;
+      memcpy(cmd + n, text, t);
+      n += t;
+      cmd[n++] = '#';
+      cmd[n] = '\0';
+      return true;
+    }
+  }
+  if (n + len + 1 > cap) return false;
+  memcpy(cmd + n, payload + 1, len - 1);
+  n += len - 1;
+  cmd[n++] = '#';
+  cmd[n] = '\0';
+  return true;
+}
+
+// Frame the reply to cmd, packed when it has the expected format
+size_t frameEncodeReply(const char *cmd, const char *reply, uint8_t seq, uint8_t *out) {
+  const char *args;
+  size_t argLen;
+  const FrameOp *op = findOp(cmd, &args, &argLen);
+  size_t len = strlen(reply);
+
+  if (op != nullptr && op->reply != PACK_TEXT && len > 0 && reply[len - 1] == '#') {
+    uint8_t n = pack(op->reply, reply, len - 1, out + 2);
+    if (n != 0) return finishFrame(FRAME_HEAD | FRAME_PACKED | (seq & FRAME_SEQ_MASK), out, n);
+  }
+  if (len > FRAME_MAX_PAYLOAD) len = FRAME_MAX_PAYLOAD;
+  memcpy(out + 2, reply, len);
+  return finishFrame(FRAME_HEAD | (seq & FRAME_SEQ_MASK), out, len);
+}
+
+// ============== Frame Parser ============================
+FrameResult FrameParser::feed(uint8_t b) {
+  if (pos == 0 && !(b & FRAME_HEAD)) return FRAME_NONE;  // between frames
+  if (pos == 1 && b > FRAME_MAX_PAYLOAD) {
+    pos = 0;
+    return FRAME_BAD;
+  }
+  buf[pos++] = b;
+  if (pos < 2 || pos < buf[1] + FRAME_OVERHEAD) return FRAME_NONE;
+
+  pos = 0;
+  uint16_t crc = frameCrc16(buf, buf[1] + 2);
+  bool ok = buf[buf[1] + 2] == (crc >> 8) && buf[buf[1] + 3] == (crc & 0xFF);
+  return ok ? FRAME_OK : FRAME_BAD;
+}
@@ -0,0 +1,67 @@
+#ifndef TEENSY_FRAMES_H
+#define TEENSY_FRAMES_H
+
+#include <Arduino.h>
+
+// Binary framing of the Teensy link. Negotiated with ":XF#" once a session
+// is open; the LX200Handler answers "1#" and from then on commands and
+// their replies travel as frames, translated to and from LX200 text at the
+// edges. Link control (":XS#", ":XB#", ...) stays text.
+//
+//   head  0x80 | packed << 6 | seq (6 bits)
+//   len   payload bytes
+//   payload
+//   crc   CRC-16/CCITT-FALSE over head, len and payload, high byte first
+//
+// A command payload is an opcode byte from the table in TeensyFrames.cpp
+// followed by its arguments, packed for the ones with a fixed format
+// (":Sr12:34:56#" -> op, 12, 34, 56). Opcode 0 carries the whole command
+// body as text. A reply carries the seq of its command, so replies are
+// matched by seq rather than by order, and its payload is either the reply
+// text as OnStepX sent it or, with the packed flag, e.g. "12:34:56#" as
+// three bytes. A frame that fails its CRC is known bad the moment it ends.
+
+#define FRAME_HEAD          0x80
+#define FRAME_PACKED        0x40
+#define FRAME_SEQ_MASK      0x3F
+#define FRAME_MAX_PAYLOAD     48
+#define FRAME_OVERHEAD         4  // head, len, crc
+#define FRAME_MAX_LEN       (FRAME_MAX_PAYLOAD + FRAME_OVERHEAD)
+
+uint16_t frameCrc16(const uint8_t *data, size_t len);
+
+// Bridge side
+size_t frameEncodeCommand(const char *cmd, uint8_t seq, uint8_t *out);
+uint8_t frameDecodeReply(const char *cmd, bool packed, const uint8_t *payload, uint8_t len, char *reply, uint8_t cap);
+
+// Teensy side, used by the native build's fake Teensy
+bool frameDecodeCommand(const uint8_t *payload, uint8_t len, char *cmd, size_t cap);
+size_t frameEncodeReply(const char *cmd, const char *reply, uint8_t seq, uint8_t *out);
+
+enum FrameResult : uint8_t {
+  FRAME_NONE,  // byte consumed, no frame yet
+  FRAME_OK,    // a frame with a good CRC is in
+  FRAME_BAD    // a frame ended with a bad CRC
+};
+
+// Byte at a time frame reassembly. Bytes outside a frame are skipped until
+// the next one with the head bit set.
+class FrameParser {
+  public:
+    FrameParser() { reset(); }
+
+    void reset() { pos = 0; }
+    FrameResult feed(uint8_t b);
+    bool inFrame() const { return pos != 0; }
+
+    uint8_t seq() const { return buf[0] & FRAME_SEQ_MASK; }
+    bool packed() const { return buf[0] & FRAME_PACKED; }
+    const uint8_t *payload() const { return buf + 2; }
+    uint8_t len() const { return buf[1]; }
+
+  private:
+    uint8_t buf[FRAME_MAX_LEN];
+    uint8_t pos;
+};
+
+#endif // TEENSY_FRAMES_H
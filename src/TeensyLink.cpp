@@ -0,0 +1,975 @@
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "TeensyLink.h"
+#include "BridgeConfig.h"
+#include "BridgeTrace.h"
+#include "LinkTimeouts.h"
+#include "SessionCapture.h"
+#include "TeensyFrames.h"
+
+#define TEENSY_SESSION_OPEN_CMD    ":XS#"
+#define TEENSY_SETTLE_MS              3  // after 'K', let pre-response garbage arrive
+#define TEENSY_RX_RING_LEN          256  // power of two, holds every in-flight reply
+#define TEENSY_RX_TIMEOUT_SYMBOLS     2  // idle time before the UART reports received bytes
+#define TEENSY_CHAR_STYLES           16  // opcodes whose one character reply style is known
+
+#define TEENSY_BAUD_CMD         ":XB"  // ":XB460800#" -> "1#", then the Teensy switches
+#define TEENSY_BAUD_PROBE_CMD   ":XE"  // ":XE<hex>#" -> "<hex><CRC-16 hex>#"
+#define TEENSY_BAUD_COMMIT_CMD  ":XC#" // keep the trial rate -> "1#"
+#define TEENSY_BAUD_TRIAL_MS        250  // the Teensy reverts without a commit by then
+#define TEENSY_PROBE_COUNT            4  // echoes per probe burst
+#define TEENSY_PROBE_LEN             24  // hex digits per echo
+#define TEENSY_BAUD_MAX_ERRORS        3  // link errors at a raised rate ...
+#define TEENSY_BAUD_ERROR_WINDOW_MS 60000  // ... within this long step it down
+
+#define TEENSY_FRAMES_CMD       ":XF#" // switch to binary frames -> "1#"
+#define TEENSY_FRAME_MAX_TIMEOUTS     2  // lost frame replies in a row before the session is reopened
+
+// Link control exchanges on the wire queue, above any slot index
+#define SESSION_SLOT 0xFF  // ":XS#"
+#define BAUD_SLOT    0xFE  // ":XB...#"
+#define PROBE_SLOT   0xFD  // ":XE...#"
+#define COMMIT_SLOT  0xFC  // ":XC#"
+#define FRAME_SLOT   0xFB  // ":XF#"
+
+// Rates tried in order, the first is the rate the link starts at
+static const uint32_t baudRates[] = { TEENSY_BAUD_BASE, 460800, 921600, 2000000 };
+#define BAUD_RATE_COUNT (sizeof(baudRates) / sizeof(baudRates[0]))
+
+enum LinkState : uint8_t {
+  LINK_IDLE,        // nothing outstanding on the wire
+  LINK_HANDSHAKE,   // 'L' sent, waiting for 'K'
+  LINK_SETTLE,      // 'K' received, draining garbage before the command
+  LINK_WAIT_REPLY   // commands written, collecting responses
+};
+
+enum BaudState : uint8_t {
+  BAUD_IDLE,        // running at baudRates[baudIndex]
+  BAUD_SWITCHING,   // ":XB" sent at the committed rate
+  BAUD_PROBING,     // at the trial rate, echo burst on the wire
+  BAUD_COMMITTING,  // ":XC#" sent at the trial rate
+  BAUD_REVERTING    // trial failed, waiting out the Teensy's trial window
+};
+
+// Whether the firmware follows an opcode's one character reply with '#'
+// (e.g. "1#" for a set it knows, a bare "0" for one it rejects), learned
+// from the first such reply
+enum CharStyle : uint8_t { CHAR_UNKNOWN, CHAR_HASHED, CHAR_BARE };
+
+struct CharStyleEntry {
+  uint32_t opKey;
+  CharStyle style;
+};
+
+enum SlotState : uint8_t { SLOT_FREE, SLOT_QUEUED, SLOT_SENT, SLOT_DONE };
+
+struct TeensySlot {
+  char cmd[LX200_CMD_MAX_LEN + 1];
+  char *reply;            // the submitter's buffer
+  uint8_t replyLen;
+  SlotState state;
+  LX200ReplyShape shape;  // what the reply looks like, ends it without a timeout
+  bool abandoned;       // owner went away, free as soon as the slot is done
+  bool detached;        // sent without an owner, free once done
+  uint8_t seq;          // frame sequence number its reply will carry
+  bool retried;         // already sent again after a bad frame
+  bool urgent;          // priority lane, see TeensyLink.h
+  TeensyTimes times;
+};
+
+// Small FIFO of slot indexes
+struct SlotFifo {
+  uint8_t idx[TEENSY_QUEUE_LEN];
+  uint8_t head;
+  uint8_t count;
+
+  void clear() { head = count = 0; }
+  bool empty() const { return count == 0; }
+  uint8_t front() const { return idx[head]; }
+  uint8_t at(uint8_t n) const { return idx[(head + n) % TEENSY_QUEUE_LEN]; }
+  void push(uint8_t i) { idx[(head + count++) % TEENSY_QUEUE_LEN] = i; }
+  void pushFront(uint8_t i) { head = (head + TEENSY_QUEUE_LEN - 1) % TEENSY_QUEUE_LEN; idx[head] = i; count++; }
+
+  // Put i in as the n-th entry, the ones from there on move back
+  void insertAt(uint8_t n, uint8_t i) {
+    for (uint8_t k = count; k > n; k--) idx[(head + k) % TEENSY_QUEUE_LEN] = at(k - 1);
+    idx[(head + n) % TEENSY_QUEUE_LEN] = i;
+    count++;
+  }
+  uint8_t pop() { uint8_t i = idx[head]; head = (head + 1) % TEENSY_QUEUE_LEN; count--; return i; }
+
+  // Take out the n-th entry, the ones behind it move up
+  uint8_t removeAt(uint8_t n) {
+    uint8_t i = at(n);
+    for (; n + 1 < count; n++) idx[(head + n) % TEENSY_QUEUE_LEN] = at(n + 1);
+    count--;
+    return i;
+  }
+};
+
+static TeensySlot slots[TEENSY_QUEUE_LEN];
+static SlotFifo sendQueue;   // submitted, not yet written
+static SlotFifo wireQueue;   // written, waiting on a reply
+
+static LinkState linkState = LINK_IDLE;
+static unsigned long stateSince = 0;  // when linkState was entered
+static bool openingSession = false;   // current handshake is for ":XS#"
+
+static char ctrlReply[LX200_REPLY_MAX_LEN + 1];     // reply to a link control command
+static char discardReply[LX200_REPLY_MAX_LEN + 1];  // reply nobody takes
+static uint8_t rxLen = 0;             // bytes of the front reply so far
+static unsigned long replyStart = 0;  // when the front reply became due
+static bool replyStarted = false;     // first byte of the front reply seen
+static unsigned long replyFirstByte = 0;
+static uint32_t replyStartUs = 0;     // same two, for the timeout estimates
+static uint32_t replyFirstByteUs = 0;
+static uint32_t replyOpKey = 0;       // opcode of the front reply
+static LX200ReplyShape replyShape = LX200_SHAPE_TERMINATED;
+static CharStyle charStyle = CHAR_UNKNOWN;  // of the front reply
+static CharStyleEntry charStyles[TEENSY_CHAR_STYLES];
+static uint8_t charStyleNext = 0;           // entry replaced next
+static bool wireAlone = false;              // nothing is written behind the reply on the wire
+static ReplyTimeouts replyTimeouts;   // its windows, see LinkTimeouts.h
+static ReplyTimeouts replyLimits;     // how far backOffReply() stretches them
+static uint16_t ackTimeout = TEENSY_ACK_TIMEOUT;
+static uint32_t ackStartUs = 0;
+
+static bool sessionActive = false;
+static unsigned long lastSessionAttempt = 0;
+static bool sessionAttempted = false;
+static bool sessionRefused = false;   // the firmware answered ":XS#" with other than "1#"
+
+static BaudState baudState = BAUD_IDLE;
+static unsigned long baudSince = 0;
+static uint8_t baudIndex = 0;                      // committed rate
+static uint8_t baudTarget = 0;                     // rate on trial
+static uint8_t baudCeiling = BAUD_RATE_COUNT - 1;  // highest rate still worth trying
+static uint8_t probesChecked = 0;
+static uint32_t probeSeed = 0;
+static uint8_t linkErrors = 0;
+static unsigned long errorWindowStart = 0;
+
+static bool framesActive = false;     // commands and replies travel as frames
+static bool framesAttempted = false;  // ":XF#" asked this session
+static bool framesOpening = false;    // ":XF#" on the wire
+static uint8_t frameSeq = 0;
+static uint8_t frameTimeouts = 0;     // in a row
+static FrameParser rxFrame;
+
+// ============= UART Receive =============================
+// The onReceive() callback runs in the UART driver's event task and is the
+// only reader of SERIAL_TEENSY. It moves the bytes into rxRing (single
+// producer, the bridge loop is the single consumer) and wakes the loop
+// task. It only runs once the line has gone idle (or the FIFO filled), so
+// that is once per reply, handshake 'K' or bare one character answer.
+static uint8_t rxRing[TEENSY_RX_RING_LEN];
+static std::atomic<uint16_t> rxHead(0);  // next byte to write
+static std::atomic<uint16_t> rxTail(0);  // next byte to read
+static TaskHandle_t loopTask = nullptr;
+
+static void onTeensyReceive() {
+  uint16_t h = rxHead.load(std::memory_order_relaxed);
+  uint16_t start = h;
+  while (SERIAL_TEENSY.available()) {
+    int c = SERIAL_TEENSY.read();
+    if (c < 0) break;
+    // Full: drop the byte, the reply times out and the link resyncs
+    if ((uint16_t)(h - rxTail.load(std::memory_order_acquire)) >= TEENSY_RX_RING_LEN) continue;
+    rxRing[h % TEENSY_RX_RING_LEN] = (uint8_t)c;
+    h++;
+  }
+  rxHead.store(h, std::memory_order_release);
+  if (h != start && loopTask != nullptr) xTaskNotifyGive(loopTask);
+}
+
+static bool rxAvailable() {
+  return rxTail.load(std::memory_order_relaxed) != rxHead.load(std::memory_order_acquire);
+}
+
+static char rxPeek() {
+  return (char)rxRing[rxTail.load(std::memory_order_relaxed) % TEENSY_RX_RING_LEN];
+}
+
+static char rxRead() {
+  uint16_t t = rxTail.load(std::memory_order_relaxed);
+  char c = (char)rxRing[t % TEENSY_RX_RING_LEN];
+  rxTail.store(t + 1, std::memory_order_release);
+  CAPTURE(CAP_TEENSY_IN, 0, &c, 1);
+  return c;
+}
+
+static void rxFlush() {
+  rxTail.store(rxHead.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+static void enterState(LinkState s) {
+  linkState = s;
+  stateSince = millis();
+}
+
+// Where the reply at the front of the wire queue goes
+static char *frontReply() {
+  uint8_t i = wireQueue.front();
+  return i < TEENSY_QUEUE_LEN ? slots[i].reply : ctrlReply;
+}
+
+static void appendReply(char c) {
+  char *buf = frontReply();
+  if (rxLen < LX200_REPLY_MAX_LEN) buf[rxLen++] = c;
+  else if (c == '#') buf[rxLen - 1] = c;  // too long, keep the terminator
+  buf[rxLen] = '\0';
+}
+
+static void completeSlot(uint8_t i, uint8_t len) {
+  if (slots[i].abandoned || slots[i].detached) {
+    slots[i].state = SLOT_FREE;
+    return;
+  }
+  slots[i].replyLen = len;
+  slots[i].reply[len] = '\0';
+  slots[i].times.replied = micros();
+  slots[i].state = SLOT_DONE;
+}
+
+// Polls and other commands that change nothing, safe to reorder or send twice
+static bool readOnly(uint8_t i) {
+  return !lx200Lookup(slots[i].cmd).invalidatesCache;
+}
+
+// Urgent slots queue ahead of polls, but behind earlier urgent ones and
+// anything that changes the mount: a stop never overtakes the goto it ends
+static void queueSlot(uint8_t i) {
+  uint8_t n = sendQueue.count;
+  if (slots[i].urgent) {
+    while (n > 0 && !slots[sendQueue.at(n - 1)].urgent && readOnly(sendQueue.at(n - 1))) n--;
+  }
+  sendQueue.insertAt(n, i);
+}
+
+static bool urgentQueued() {
+  return !sendQueue.empty() && slots[sendQueue.front()].urgent;
+}
+
+// Opcode of the reply at the front of the wire queue
+static uint32_t frontOpKey() {
+  switch (uint8_t i = wireQueue.front()) {
+    case SESSION_SLOT: return lx200CmdKey(TEENSY_SESSION_OPEN_CMD);
+    case BAUD_SLOT:    return lx200CmdKey(TEENSY_BAUD_CMD "#");
+    case PROBE_SLOT:   return lx200CmdKey(TEENSY_BAUD_PROBE_CMD "#");
+    case COMMIT_SLOT:  return lx200CmdKey(TEENSY_BAUD_COMMIT_CMD);
+    case FRAME_SLOT:   return lx200CmdKey(TEENSY_FRAMES_CMD);
+    default:           return lx200CmdKey(slots[i].cmd);
+  }
+}
+
+static CharStyle charStyleFor(uint32_t opKey) {
+  for (uint8_t i = 0; i < TEENSY_CHAR_STYLES; i++) {
+    if (charStyles[i].opKey == opKey) return charStyles[i].style;
+  }
+  return CHAR_UNKNOWN;
+}
+
+static void learnCharStyle(CharStyle style) {
+  charStyle = style;
+  charStyles[charStyleNext] = { replyOpKey, style };
+  charStyleNext = (charStyleNext + 1) % TEENSY_CHAR_STYLES;
+}
+
+static uint16_t backOffLimit(uint16_t windowMs, uint16_t maxMs) {
+  uint32_t ms = (uint32_t)windowMs << LINK_TIMEOUT_MAX_BACKOFF;
+  return ms < maxMs ? ms : maxMs;
+}
+
+// Call once the reply at the front of the wire queue becomes due
+static void startReply() {
+  rxLen = 0;
+  frontReply()[0] = '\0';
+  replyStart = millis();
+  replyStartUs = micros();
+  replyStarted = false;
+  replyOpKey = frontOpKey();
+  if (wireQueue.front() < TEENSY_QUEUE_LEN) {
+    replyShape = slots[wireQueue.front()].shape;
+    replyTimeouts = linkTimeoutsFor(replyOpKey);
+    replyLimits = { backOffLimit(replyTimeouts.firstByteMs, LINK_FIRST_BYTE_MAX_MS),
+                    backOffLimit(replyTimeouts.replyMs, LINK_REPLY_MAX_MS) };
+    if (replyShape == LX200_SHAPE_CHAR) charStyle = charStyleFor(replyOpKey);
+  } else {
+    // Link control, never learned. Firmware that doesn't know the command
+    // passes it on to OnStepX, which answers a bare "0". Probe echoes are
+    // hex and could start with one.
+    replyShape = wireQueue.front() == PROBE_SLOT ? LX200_SHAPE_TERMINATED : LX200_SHAPE_UNKNOWN;
+    replyTimeouts = { LINK_FIRST_BYTE_MAX_MS, LINK_REPLY_MAX_MS };
+    replyLimits = replyTimeouts;
+  }
+}
+
+static void writeCommand(const char *cmd) {
+  SERIAL_TEENSY.print(cmd);
+  CAPTURE(CAP_TEENSY_OUT, 0, cmd, strlen(cmd));
+}
+
+static void writeFrame(uint8_t i) {
+  uint8_t frame[FRAME_MAX_LEN];
+  slots[i].seq = frameSeq;
+  frameSeq = (frameSeq + 1) & FRAME_SEQ_MASK;
+  size_t n = frameEncodeCommand(slots[i].cmd, slots[i].seq, frame);
+  SERIAL_TEENSY.write(frame, n);
+  CAPTURE(CAP_TEENSY_OUT, 0, frame, n);
+}
+
+// Write a queued slot, returns false if nothing was left to send
+static bool writeNextQueued() {
+  while (!sendQueue.empty()) {
+    uint8_t i = sendQueue.pop();
+    if (slots[i].abandoned) {
+      slots[i].state = SLOT_FREE;
+      continue;
+    }
+    if (framesActive) {
+      writeFrame(i);
+    } else {
+      // Until an opcode's style is known a '#' after its character could as
+      // well be the next reply, so it goes on the wire last. So does a
+      // command whose reply could be anything.
+      if (slots[i].shape == LX200_SHAPE_UNKNOWN ||
+          (slots[i].shape == LX200_SHAPE_CHAR && charStyleFor(lx200CmdKey(slots[i].cmd)) == CHAR_UNKNOWN)) {
+        wireAlone = true;
+      }
+      writeCommand(slots[i].cmd);
+    }
+    slots[i].times.written = micros();
+    slots[i].state = SLOT_SENT;
+
+    // Nothing comes back for these, so they are done once written
+    if (slots[i].shape == LX200_SHAPE_NONE) {
+      completeSlot(i, 0);
+    } else {
+      wireQueue.push(i);
+      if (wireQueue.count == 1) startReply();
+    }
+    return true;
+  }
+  return false;
+}
+
+// Whether the next queued command may go on the wire now. Urgent ones
+// skip the in-flight limit. While a reply that can't be told apart from
+// the next one is on the wire (a one character reply style being learned,
+// an unknown command) only commands without a reply go, and an unknown
+// command itself waits for the wire to be empty. Frames carry their seq,
+// so none of this applies to them.
+static bool mayWriteNext() {
+  if (sendQueue.empty()) return false;
+  const TeensySlot &s = slots[sendQueue.front()];
+  if (!framesActive && s.shape == LX200_SHAPE_UNKNOWN) return wireQueue.empty();
+  if (s.urgent) return !wireAlone || framesActive || s.shape == LX200_SHAPE_NONE;
+  return !wireAlone && wireQueue.count < TEENSY_MAX_IN_FLIGHT;
+}
+
+// Write a link control command, its reply is matched by slot
+static void writeControl(const char *cmd, uint8_t slot) {
+  writeCommand(cmd);
+  wireQueue.push(slot);
+  if (wireQueue.count == 1) startReply();
+}
+
+// ================ Handshake Teensy =====================
+// Handshake Teensy: Send 'L' and wait for 'K'
+static void startHandshake() {
+  ackTimeout = linkAckTimeout();
+  ackStartUs = micros();
+  SERIAL_TEENSY.write('L');
+  CAPTURE(CAP_TEENSY_OUT, 0, "L", 1);
+  SERIAL_TEENSY.flush();
+  enterState(LINK_HANDSHAKE);
+}
+
+// After the handshake, send the ":XS#" request or the next queued command
+static void writeAfterHandshake() {
+  if (openingSession) {
+    writeControl(TEENSY_SESSION_OPEN_CMD, SESSION_SLOT);
+  } else {
+    writeNextQueued();
+  }
+  SERIAL_TEENSY.flush();
+  enterState(wireQueue.empty() ? LINK_IDLE : LINK_WAIT_REPLY);
+}
+
+// ============= Open Teensy Session ======================
+// Ask the LX200Handler to stop expecting 'L' before every command.
+// Firmware without session support passes ":XS#" on to OnStepX which
+// rejects it, so anything other than "1#" means stay in per-command mode.
+static void openTeensySession() {
+  sessionAttempted = true;
+  lastSessionAttempt = millis();
+  openingSession = true;
+  startHandshake();
+}
+
+static void dropSession() {
+  TRACE_EVENT(TRACE_SESSION_LOST, 0);
+  sessionActive = false;
+  sessionAttempted = false;
+  if (framesActive) framesAttempted = false;  // ask again, firmware that refused stays on text
+  framesActive = false;
+}
+
+// ============= Baud Negotiation =========================
+// With a session open the link steps up through baudRates. At each step
+// ":XB<rate>#" is answered "1#" at the old rate, then both sides switch
+// and a burst of ":XE#" echoes with a CRC-16 is checked. Only a clean
+// burst is followed by ":XC#", without it the Teensy drops back to the
+// old rate after TEENSY_BAUD_TRIAL_MS. Repeated link errors at a raised
+// rate step it down again.
+static void setBaudState(BaudState s) {
+  baudState = s;
+  baudSince = millis();
+}
+
+// Hex payload of probe n in the current burst. Hex digits never clash
+// with the 'K' and '#' the reply reader treats specially.
+static void probePayload(uint8_t n, char *out) {
+  uint32_t x = (probeSeed + n * 0x9E3779B9u) | 1;
+  for (uint8_t i = 0; i < TEENSY_PROBE_LEN; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    out[i] = "0123456789ABCDEF"[x & 0xF];
+  }
+  out[TEENSY_PROBE_LEN] = '\0';
+}
+
+static void writeProbe(uint8_t n) {
+  char payload[TEENSY_PROBE_LEN + 1];
+  char cmd[LX200_CMD_MAX_LEN + 1];
+  probePayload(n, payload);
+  snprintf(cmd, sizeof(cmd), TEENSY_BAUD_PROBE_CMD "%s#", payload);
+  writeControl(cmd, PROBE_SLOT);
+}
+
+static bool probeEchoOk(uint8_t n, const char *resp) {
+  char payload[TEENSY_PROBE_LEN + 1];
+  char expect[TEENSY_PROBE_LEN + 6];
+  probePayload(n, payload);
+  snprintf(expect, sizeof(expect), "%s%04X#", payload, frameCrc16((const uint8_t *)payload, TEENSY_PROBE_LEN));
+  return strcmp(resp, expect) == 0;
+}
+
+static void startBaudSwitch(uint8_t target) {
+  char cmd[16];
+  snprintf(cmd, sizeof(cmd), TEENSY_BAUD_CMD "%lu#", (unsigned long)baudRates[target]);
+  baudTarget = target;
+  setBaudState(BAUD_SWITCHING);
+  writeControl(cmd, BAUD_SLOT);
+  SERIAL_TEENSY.flush();
+  enterState(LINK_WAIT_REPLY);
+}
+
+// The raised rate stopped working altogether. Drop to the base rate, which
+// the Teensy also does when it sees framing errors, and reopen the session.
+static void baudFallback() {
+  SERIAL_DEBUG.printf("Teensy link lost at %lu baud, back to %lu\n",
+                      (unsigned long)baudRates[baudIndex], (unsigned long)TEENSY_BAUD_BASE);
+  baudCeiling = baudIndex - 1;
+  baudIndex = 0;
+  linkErrors = 0;  // counted at the rate just given up
+  errorWindowStart = millis();
+  SERIAL_TEENSY.updateBaudRate(TEENSY_BAUD_BASE);
+  setBaudState(BAUD_IDLE);
+  sessionActive = false;
+  sessionAttempted = false;
+  if (framesActive) framesAttempted = false;
+  framesActive = false;
+}
+
+// Go back to the committed rate and write nothing until the Teensy has
+// done the same at the end of its trial window
+static void baudTrialFailed() {
+  while (!wireQueue.empty()) wireQueue.pop();  // only control exchanges are on the wire
+  rxFlush();
+  if (baudTarget < baudIndex) {
+    baudFallback();
+    return;
+  }
+  baudCeiling = baudTarget - 1;
+  SERIAL_TEENSY.updateBaudRate(baudRates[baudIndex]);
+  setBaudState(BAUD_REVERTING);
+  SERIAL_DEBUG.printf("Teensy link failed at %lu baud, staying at %lu\n",
+                      (unsigned long)baudRates[baudTarget], (unsigned long)baudRates[baudIndex]);
+}
+
+static void finishBaudReply(uint8_t slot, const char *resp) {
+  switch (slot) {
+    case BAUD_SLOT:
+      if (strcmp(resp, "1#") == 0) {
+        SERIAL_TEENSY.updateBaudRate(baudRates[baudTarget]);
+        probeSeed = micros();
+        probesChecked = 0;
+        setBaudState(BAUD_PROBING);
+        for (uint8_t n = 0; n < TEENSY_PROBE_COUNT; n++) writeProbe(n);
+        SERIAL_TEENSY.flush();
+      } else if (resp[0] == '0' && baudTarget > baudIndex) {
+        // Firmware without baud negotiation, stay where we are
+        baudCeiling = baudIndex;
+        setBaudState(BAUD_IDLE);
+      } else {
+        baudTrialFailed();
+      }
+      break;
+
+    case PROBE_SLOT:
+      if (!probeEchoOk(probesChecked, resp)) {
+        baudTrialFailed();
+      } else if (++probesChecked == TEENSY_PROBE_COUNT) {
+        setBaudState(BAUD_COMMITTING);
+        writeControl(TEENSY_BAUD_COMMIT_CMD, COMMIT_SLOT);
+        SERIAL_TEENSY.flush();
+      }
+      break;
+
+    case COMMIT_SLOT:
+      if (strcmp(resp, "1#") == 0) {
+        baudIndex = baudTarget;
+        linkErrors = 0;
+        setBaudState(BAUD_IDLE);
+        SERIAL_DEBUG.printf("Teensy link at %lu baud\n", (unsigned long)baudRates[baudIndex]);
+      } else {
+        baudTrialFailed();
+      }
+      break;
+  }
+}
+
+// Count replies lost at a raised rate
+static void noteLinkError() {
+  unsigned long now = millis();
+  if (now - errorWindowStart >= TEENSY_BAUD_ERROR_WINDOW_MS) {
+    errorWindowStart = now;
+    linkErrors = 0;
+  }
+  if (baudIndex > 0 && linkErrors < 255) linkErrors++;
+}
+
+#if TEENSY_BAUD_NEGOTIATE
+// Start the next baud step once the wire is quiet
+static void serviceBaud() {
+  if (baudState == BAUD_REVERTING && millis() - baudSince >= TEENSY_BAUD_TRIAL_MS) setBaudState(BAUD_IDLE);
+  if (baudState != BAUD_IDLE || !sessionActive || linkState != LINK_IDLE || !wireQueue.empty()) return;
+
+  if (millis() - errorWindowStart >= TEENSY_BAUD_ERROR_WINDOW_MS) linkErrors = 0;
+  if (linkErrors >= TEENSY_BAUD_MAX_ERRORS && baudIndex > 0) {
+    baudCeiling = baudIndex - 1;
+    linkErrors = 0;
+    startBaudSwitch(baudIndex - 1);
+  } else if (baudIndex < baudCeiling) {
+    startBaudSwitch(baudIndex + 1);
+  }
+}
+#endif
+
+// ============= Binary Frames ============================
+// Once the session is open and the baud rate has settled, ask for binary
+// frames (see TeensyFrames.h). Firmware without them rejects ":XF#" and
+// the link stays on LX200 text.
+#if TEENSY_FRAMES
+static void serviceFrames() {
+  if (framesActive || framesAttempted || !sessionActive || baudState != BAUD_IDLE) return;
+#if TEENSY_BAUD_NEGOTIATE
+  if (baudIndex < baudCeiling) return;  // still stepping up
+#endif
+  if (linkState != LINK_IDLE || !wireQueue.empty()) return;
+
+  framesAttempted = true;
+  framesOpening = true;
+  writeControl(TEENSY_FRAMES_CMD, FRAME_SLOT);
+  SERIAL_TEENSY.flush();
+  enterState(LINK_WAIT_REPLY);
+}
+#endif
+
+static void finishFramesOpen(const char *resp) {
+  framesOpening = false;
+  framesActive = strcmp(resp, "1#") == 0;
+  frameTimeouts = 0;
+  rxFrame.reset();
+  if (framesActive) SERIAL_DEBUG.println("Teensy link using binary frames");
+}
+
+// Firmware that answered anything is not asked again, only a timeout is
+// worth a retry
+static void finishSessionOpen(const char *resp) {
+  openingSession = false;
+  sessionActive = strcmp(resp, "1#") == 0;
+  if (!sessionActive && baudIndex > 0) {
+    baudFallback();
+    return;
+  }
+  sessionRefused = !sessionActive && resp[0] != '\0';
+  SERIAL_DEBUG.println(sessionActive ? "Teensy session opened" : "Teensy session not supported, using handshake per command");
+}
+
+// ============= Finish Front Reply =======================
+// timedOut is set if no '#' terminator was seen
+static void finishReply(bool timedOut) {
+  uint8_t i = wireQueue.pop();
+
+  if (i == SESSION_SLOT) {
+    finishSessionOpen(ctrlReply);
+  } else if (i == FRAME_SLOT) {
+    finishFramesOpen(ctrlReply);
+  } else if (i >= COMMIT_SLOT) {
+    finishBaudReply(i, ctrlReply);
+  } else {
+    completeSlot(i, rxLen);
+    if (!timedOut) {
+      linkTimeoutsSample(replyOpKey, replyFirstByteUs - replyStartUs, micros() - replyFirstByteUs);
+    } else if (replyShape == LX200_SHAPE_UNKNOWN && !framesActive) {
+      // No reply, or one without a '#', is just how this command answers.
+      // It was alone on the wire, so nothing is out of step, only a late
+      // byte could still come.
+      rxFlush();
+      timedOut = false;
+    } else {
+      linkTimeoutsMissed(replyOpKey);
+      // Only a wait at the ceiling says the reply was lost on the line. A
+      // learned window that is too short says nothing about the rate.
+      bool atCeiling = replyStarted ? replyTimeouts.replyMs >= LINK_REPLY_MAX_MS
+                                    : replyTimeouts.firstByteMs >= LINK_FIRST_BYTE_MAX_MS;
+      if (atCeiling) noteLinkError();
+    }
+
+    // Lost sync with the Teensy (e.g. it rebooted). Responses still in
+    // flight can no longer be matched, so discard them and handshake
+    // again next time. Frames name their command, so one lost frame
+    // reply is not enough to give up on them.
+    if (timedOut && framesActive && ++frameTimeouts < TEENSY_FRAME_MAX_TIMEOUTS) {
+      rxFrame.reset();
+    } else if (timedOut && sessionActive) {
+      dropSession();
+      while (!wireQueue.empty()) completeSlot(wireQueue.pop(), 0);
+      rxFlush();
+    }
+  }
+  if (wireQueue.empty()) wireAlone = false;
+  else startReply();
+}
+
+// ============= Preempt For Urgent =======================
+// Without a session one command is on the wire at a time. A stop must not
+// wait out a poll's reply, so the poll goes back in the queue behind it
+// and its reply is skipped while waiting for the next 'K'. Only polls are
+// safe to send twice: a goto, park or set the Teensy already ran keeps
+// the wire until it answers.
+static void preemptForUrgent() {
+  if (sessionActive || wireQueue.count != 1 || !urgentQueued()) return;
+  uint8_t i = wireQueue.front();
+  if (i >= TEENSY_QUEUE_LEN || slots[i].urgent || !readOnly(i)) return;
+
+  TRACE_EVENT(TRACE_PREEMPTED, lx200CmdKey(slots[i].cmd));
+  wireQueue.pop();
+  slots[i].state = SLOT_QUEUED;
+  queueSlot(i);
+  wireAlone = false;
+}
+
+// ============= Read Teensy Frames =======================
+// A reply frame completes the command with its seq, wherever that is on
+// the wire queue. A late reply to a command already given up on matches
+// nothing and is dropped.
+static int8_t wirePosForSeq(uint8_t seq) {
+  for (uint8_t n = 0; n < wireQueue.count; n++) {
+    uint8_t i = wireQueue.at(n);
+    if (i < TEENSY_QUEUE_LEN && slots[i].seq == seq) return n;
+  }
+  return -1;
+}
+
+// The seq of a frame that failed its CRC may itself be corrupt, so it
+// can't name the command the frame was for. Only a poll at the front of
+// the wire with that seq is asked again right away, that is harmless
+// even if the frame was not its. Anything else is left to its timeout.
+static void frameFailed() {
+  uint8_t i = wireQueue.front();
+  bool front = i < TEENSY_QUEUE_LEN && slots[i].seq == rxFrame.seq();
+  TRACE_EVENT(TRACE_FRAME_BAD, front ? lx200CmdKey(slots[i].cmd) : 0);
+  noteLinkError();
+  if (!front || slots[i].retried || !readOnly(i)) return;
+
+  wireQueue.pop();
+  slots[i].retried = true;
+  slots[i].state = SLOT_QUEUED;
+  sendQueue.pushFront(i);
+  if (!wireQueue.empty()) startReply();
+}
+
+static void finishFrame() {
+  int8_t pos = wirePosForSeq(rxFrame.seq());
+  if (pos < 0) return;
+
+  uint8_t i = wireQueue.removeAt(pos);
+  uint8_t len = frameDecodeReply(slots[i].cmd, rxFrame.packed(), rxFrame.payload(), rxFrame.len(),
+                                 slots[i].reply, LX200_REPLY_MAX_LEN);
+  if (pos == 0) linkTimeoutsSample(replyOpKey, replyFirstByteUs - replyStartUs, micros() - replyFirstByteUs);
+  frameTimeouts = 0;
+  completeSlot(i, len);
+  if (pos == 0 && !wireQueue.empty()) startReply();
+}
+
+static bool readTeensyFrames() {
+  bool gotBytes = false;
+  while (!wireQueue.empty() && rxAvailable()) {
+    uint8_t b = (uint8_t)rxRead();
+    gotBytes = true;
+    if (!replyStarted) {
+      replyStarted = true;
+      replyFirstByte = millis();
+      replyFirstByteUs = micros();
+    }
+    FrameResult r = rxFrame.feed(b);
+    if (r == FRAME_OK) finishFrame();
+    else if (r == FRAME_BAD) frameFailed();
+  }
+  return gotBytes;
+}
+
+// ============= Read Teensy Response =====================
+// Collect bytes for the reply at the front of the wire queue. A reply ends
+// at its '#', or for a one character reply as soon as that character is in
+// (plus the '#' if this firmware sends one). Returns true if any bytes arrived.
+static bool readTeensyText() {
+  bool gotBytes = false;
+  while (!wireQueue.empty() && rxAvailable()) {
+    char rc = rxRead();
+    gotBytes = true;
+    if (!replyStarted) {
+      replyStarted = true;
+      replyFirstByte = millis();
+      replyFirstByteUs = micros();
+    }
+
+    // Skip early junk like stray 'K', '\n', etc.
+    if (rc == 'K' || rc == '\n' || rc == '\r') continue;
+
+    appendReply(rc);
+    if (rc == '#') {
+      finishReply(false);
+    } else if (replyShape == LX200_SHAPE_UNKNOWN && rxLen == 1 && rc == '0' && !rxAvailable()) {
+      finishReply(false);  // OnStepX doesn't know it, a '#' would have come in the same burst
+    } else if (replyShape == LX200_SHAPE_CHAR && rxLen == 1) {
+      // Style still unknown: the callback hands over each burst whole, so
+      // a '#' sent with the character is already here. Anything else, or
+      // nothing, means the reply was just the character.
+      if (charStyle == CHAR_UNKNOWN) {
+        bool hashed = rxAvailable() && rxPeek() == '#';
+        learnCharStyle(hashed ? CHAR_HASHED : CHAR_BARE);
+        if (hashed) appendReply(rxRead());
+        finishReply(false);
+      } else if (charStyle == CHAR_BARE) {
+        finishReply(false);
+      }
+    }
+  }
+  return gotBytes;
+}
+
+// A text reply that misses its learned window may only be slow, and
+// giving up on it drops the session with everything in flight. So the
+// window doubles and the wait goes on, up to 2^LINK_TIMEOUT_MAX_BACKOFF
+// times the learned one, before the reply counts as lost. Frames survive
+// a lost reply, and a command whose reply could be anything ends by
+// timing out, so neither waits longer. Returns true if the wait goes on.
+static bool backOffReply(uint16_t &windowMs, uint16_t limitMs) {
+  if (framesActive || replyShape == LX200_SHAPE_UNKNOWN || windowMs >= limitMs) return false;
+  windowMs = windowMs < limitMs / 2 ? windowMs * 2 : limitMs;
+  linkTimeoutsMissed(replyOpKey);
+  return true;
+}
+
+// Link control replies are always text
+static bool readTeensyResponse() {
+  bool frames = framesActive && !wireQueue.empty() && wireQueue.front() < TEENSY_QUEUE_LEN;
+  bool gotBytes = frames ? readTeensyFrames() : readTeensyText();
+  if (wireQueue.empty()) return gotBytes;
+
+  unsigned long now = millis();
+  if (!replyStarted && (now - replyStart) >= replyTimeouts.firstByteMs) {
+    if (backOffReply(replyTimeouts.firstByteMs, replyLimits.firstByteMs)) return gotBytes;
+    TRACE_EVENT(TRACE_TIMEOUT_FIRST, replyOpKey);
+    finishReply(true);
+  } else if (replyStarted && (now - replyFirstByte) >= replyTimeouts.replyMs) {
+    if (backOffReply(replyTimeouts.replyMs, replyLimits.replyMs)) return gotBytes;
+    TRACE_EVENT(TRACE_TIMEOUT_TERM, replyOpKey);
+    finishReply(true);  // Might be partial
+  }
+  return gotBytes;
+}
+
+void teensyLinkBegin() {
+  sessionActive = false;
+  sessionAttempted = false;
+  sessionRefused = false;
+  openingSession = false;
+  memset(charStyles, 0, sizeof(charStyles));
+  wireAlone = false;
+  framesActive = framesAttempted = framesOpening = false;
+  baudIndex = 0;
+  baudCeiling = BAUD_RATE_COUNT - 1;
+  linkErrors = 0;
+  setBaudState(BAUD_IDLE);
+  sendQueue.clear();
+  wireQueue.clear();
+  for (uint8_t i = 0; i < TEENSY_QUEUE_LEN; i++) slots[i].state = SLOT_FREE;
+  enterState(LINK_IDLE);
+
+  loopTask = xTaskGetCurrentTaskHandle();
+  rxFlush();
+  SERIAL_TEENSY.setRxTimeout(TEENSY_RX_TIMEOUT_SYMBOLS);
+  SERIAL_TEENSY.onReceive(onTeensyReceive);
+#if TEENSY_SESSION_MODE
+  openTeensySession();
+#endif
+}
+
+bool teensySessionActive() {
+  return sessionActive;
+}
+
+bool teensyLinkIdle() {
+  return linkState == LINK_IDLE && sendQueue.empty();
+}
+
+// ============= Service Teensy Link ======================
+// Advance the link state machine, never blocks. Returns true if anything
+// happened so the caller knows not to sleep.
+bool teensyLinkService() {
+  LinkState before = linkState;
+  uint8_t queued = sendQueue.count;
+  uint8_t onWire = wireQueue.count;
+  bool gotBytes = false;
+
+  switch (linkState) {
+    case LINK_HANDSHAKE:
+      while (rxAvailable()) {
+        if (rxRead() == 'K') {
+          linkAckSample(micros() - ackStartUs);
+          enterState(LINK_SETTLE);
+          break;
+        }
+      }
+      // No 'K', send the command anyway like the Teensy might still be listening
+      if (linkState == LINK_HANDSHAKE && millis() - stateSince >= ackTimeout) {
+        linkAckMissed();
+        writeAfterHandshake();
+      }
+      break;
+
+    case LINK_SETTLE:
+      if (millis() - stateSince >= TEENSY_SETTLE_MS) {
+        // Flush any remaining pre-response garbage
+        rxFlush();
+        writeAfterHandshake();
+      }
+      break;
+
+    case LINK_WAIT_REPLY:
+      gotBytes = readTeensyResponse();
+      if (!wireQueue.empty()) preemptForUrgent();
+      if (wireQueue.empty()) enterState(LINK_IDLE);
+      break;
+
+    case LINK_IDLE:
+      // Nothing is owed to us, anything arriving now is junk
+      rxFlush();
+      break;
+  }
+
+#if TEENSY_BAUD_NEGOTIATE
+  serviceBaud();
+#endif
+#if TEENSY_FRAMES
+  serviceFrames();
+#endif
+
+  // Session mode keeps up to TEENSY_MAX_IN_FLIGHT commands on the wire,
+  // nothing goes out while the baud rate or the framing is being changed
+  if (sessionActive && baudState == BAUD_IDLE && !framesOpening &&
+      (linkState == LINK_IDLE || linkState == LINK_WAIT_REPLY)) {
+    bool wrote = false;
+    while (mayWriteNext() && writeNextQueued()) wrote = true;
+    if (wrote) SERIAL_TEENSY.flush();
+    if (!wireQueue.empty() && linkState == LINK_IDLE) enterState(LINK_WAIT_REPLY);
+  }
+
+  // Otherwise start the next exchange once the wire is quiet
+  if (linkState == LINK_IDLE && !sendQueue.empty()) {
+#if TEENSY_SESSION_MODE
+    if (!sessionActive && !sessionRefused &&
+        (!sessionAttempted || millis() - lastSessionAttempt >= TEENSY_SESSION_RETRY_MS)) {
+      openTeensySession();
+    }
+#endif
+    if (linkState == LINK_IDLE && !sessionActive) startHandshake();
+  }
+
+  return gotBytes || linkState != before || sendQueue.count != queued || wireQueue.count != onWire;
+}
+
+// Sleep for up to maxMs, returning early once a Teensy reply is complete
+void teensyLinkWait(uint32_t maxMs) {
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(maxMs));
+}
+
+// ============= Submit Teensy Command ====================
+// Queue a command for the Teensy. Returns TEENSY_NO_TICKET if the queue is
+// full, for other than urgent commands already when only the reserve is left.
+TeensyTicket teensySubmit(const char *cmd, char *reply, LX200ReplyShape shape, bool urgent) {
+  uint8_t freeSlots = 0;
+  for (uint8_t i = 0; i < TEENSY_QUEUE_LEN; i++) freeSlots += slots[i].state == SLOT_FREE;
+  if (!urgent && freeSlots <= TEENSY_URGENT_RESERVE) return TEENSY_NO_TICKET;
+
+  for (uint8_t i = 0; i < TEENSY_QUEUE_LEN; i++) {
+    if (slots[i].state != SLOT_FREE) continue;
+    strlcpy(slots[i].cmd, cmd, sizeof(slots[i].cmd));
+    slots[i].detached = reply == nullptr;
+    slots[i].reply = reply != nullptr ? reply : discardReply;
+    slots[i].replyLen = 0;
+    slots[i].reply[0] = '\0';
+    slots[i].shape = shape;
+    slots[i].abandoned = false;
+    slots[i].retried = false;
+    slots[i].urgent = urgent;
+    slots[i].times.submitted = micros();
+    slots[i].state = SLOT_QUEUED;
+    queueSlot(i);
+    return i;
+  }
+  return TEENSY_NO_TICKET;
+}
+
+bool teensyDone(TeensyTicket t) {
+  return t >= 0 && slots[t].state == SLOT_DONE;
+}
+
+// Free the ticket of a finished command. Its reply is in the buffer
+// passed to teensySubmit(), returns its length.
+uint8_t teensyTakeResponse(TeensyTicket t, TeensyTimes *times) {
+  if (times != nullptr) *times = slots[t].times;
+  slots[t].state = SLOT_FREE;
+  return slots[t].replyLen;
+}
+
+// Give up on a ticket (e.g. the client disconnected). A command already
+// on the wire still has its reply consumed so the FIFO stays in step.
+void teensyRelease(TeensyTicket t) {
+  if (t < 0) return;
+  if (slots[t].state == SLOT_DONE) {
+    slots[t].state = SLOT_FREE;
+  } else if (slots[t].state != SLOT_FREE) {
+    // The owner's buffer may be reused right away, a reply still on its
+    // way is read into scratch
+    slots[t].abandoned = true;
+    slots[t].reply = discardReply;
+  }
+}
@@ -0,0 +1,62 @@
+#ifndef TEENSY_LINK_H
+#define TEENSY_LINK_H
+
+#include <Arduino.h>
+#include "LX200Framer.h"
+#include "LX200Commands.h"
+
+// UART link to the Teensy LX200Handler.
+//
+// Older DDScopeX firmware requires an 'L' -> 'K' handshake before every
+// command. Newer firmware accepts the private ":XS#" command after a
+// handshake, answers "1#" and from then on reads commands back-to-back
+// without the handshake. The session is dropped on any timeout and
+// re-opened on the next command. While a session is open several
+// commands can be in flight at once.
+//
+// The link never blocks: commands are queued with teensySubmit() and
+// teensyLinkService() moves them along from loop(). The caller polls its
+// ticket with teensyDone() and collects the reply with teensyTakeResponse().
+// Replies are assembled straight into the buffer the caller passed to
+// teensySubmit(), which must stay put until the ticket is taken or released.
+//
+// Urgent commands (stops and manual moves) are a priority lane: they go
+// ahead of queued polls, skip the in-flight limit, and without a session
+// preempt a poll whose reply is still awaited. The poll is asked again
+// after them. They never overtake a goto, set or other command that
+// changes the mount.
+//
+// Received bytes are moved off the UART by its onReceive() callback, which
+// wakes a loop() sleeping in teensyLinkWait() once a burst of bytes (a
+// reply or the handshake 'K') is in, so replies are picked up without polling.
+
+#define TEENSY_QUEUE_LEN      12  // commands queued or waiting on a reply
+#define TEENSY_MAX_IN_FLIGHT   4  // commands written before reading any response
+#define TEENSY_URGENT_RESERVE  2  // slots only urgent commands may take
+
+typedef int8_t TeensyTicket;
+#define TEENSY_NO_TICKET -1
+
+// micros() timestamps of a command's trip over the link
+struct TeensyTimes {
+  uint32_t submitted;  // queued by teensySubmit()
+  uint32_t written;    // written to the UART
+  uint32_t replied;    // reply complete (or timed out)
+};
+
+void teensyLinkBegin();
+bool teensyLinkService();
+void teensyLinkWait(uint32_t maxMs);
+bool teensyLinkIdle();
+bool teensySessionActive();
+
+// reply holds LX200_REPLY_MAX_LEN + 1 bytes, it is NUL terminated. With
+// reply nullptr nobody waits for the answer: the command is still sent
+// and its slot frees itself once done, the ticket is only for show.
+TeensyTicket teensySubmit(const char *cmd, char *reply, LX200ReplyShape shape = LX200_SHAPE_TERMINATED,
+                          bool urgent = false);
+bool teensyDone(TeensyTicket t);
+uint8_t teensyTakeResponse(TeensyTicket t, TeensyTimes *times = nullptr);
+void teensyRelease(TeensyTicket t);
+
+#endif // TEENSY_LINK_H
@@ -0,0 +1,141 @@
+#include "TelemetryPrefetch.h"
+#include "BridgeConfig.h"
+#include "LX200Server.h"
+#include "StellariumServer.h"
+#include "PositionBroadcast.h"
+#include "ResponseCache.h"
+#include "TeensyLink.h"
+
+#define PREFETCH_TTL_SLACK_MS  100  // covers a late cycle
+
+#define TIME_SECONDS    86400    // seconds of time in a full circle
+#define CIRCLE_ARCSEC   1296000  // arcseconds in a full circle
+#define QUARTER_ARCSEC  324000   // arcseconds in 90 degrees
+
+// Polled every cycle, the last one tells whether the mount is slewing
+static const char *const prefetchCmds[] = { ":GR#", ":GD#", ":GA#", ":GZ#", ":D#" };
+#define PREFETCH_COUNT (sizeof(prefetchCmds) / sizeof(prefetchCmds[0]))
+#define SLEW_STATUS    (PREFETCH_COUNT - 1)
+
+static TeensyTicket tickets[PREFETCH_COUNT];
+static char replies[PREFETCH_COUNT][LX200_REPLY_MAX_LEN + 1];
+static unsigned long lastCycle = 0;
+static unsigned long fastUntil = 0;  // millis() until which to poll fast
+static bool refreshNow = false;      // the mount just started or stopped
+static bool manualMove = false;      // :Me# and friends run until a stop
+static bool active = false;
+
+void prefetchBegin() {
+  for (uint8_t i = 0; i < PREFETCH_COUNT; i++) tickets[i] = TEENSY_NO_TICKET;
+}
+
+void prefetchNoteMotion(LX200Motion motion) {
+  switch (motion) {
+    case LX200_MOTION_MOVE: manualMove = true; break;
+    case LX200_MOTION_STOP: manualMove = false; break;
+    default: break;
+  }
+  fastUntil = millis() + PREFETCH_MOTION_HOLD_MS;
+  refreshNow = true;
+}
+
+// Collect finished polls into the cache. OnStepX answers :D# with a bar
+// while a goto is in progress and a lone '#' otherwise.
+static bool collectPrefetch() {
+  bool busy = false;
+  for (uint8_t i = 0; i < PREFETCH_COUNT; i++) {
+    if (tickets[i] == TEENSY_NO_TICKET || !teensyDone(tickets[i])) continue;
+    uint8_t len = teensyTakeResponse(tickets[i]);
+    tickets[i] = TEENSY_NO_TICKET;
+    cacheStore(prefetchCmds[i], replies[i], len);
+    if (i == SLEW_STATUS && len > 1 && replies[i][len - 1] == '#') {
+      fastUntil = millis() + PREFETCH_MOTION_HOLD_MS;
+    }
+    busy = true;
+  }
+  return busy;
+}
+
+// ============== Position ================================
+// "HH:MM:SS", "HH:MM.T", "sDD*MM:SS", "DDD*MM:SS" or "sDD*MM" as seconds
+// of time or arc. Any single character separates the fields.
+static bool parseSexagesimal(const char *s, int32_t &secs) {
+  bool negative = *s == '-';
+  if (*s == '-' || *s == '+') s++;
+
+  int32_t field[3] = { 0, 0, 0 };
+  uint8_t n = 0;
+  while (n < 3) {
+    if (!isdigit((uint8_t)*s)) return false;
+    int32_t v = 0;
+    while (isdigit((uint8_t)*s)) v = v * 10 + (*s++ - '0');
+    field[n++] = v;
+    if (n == 2 && *s == '.') {  // tenths of a minute
+      if (isdigit((uint8_t)s[1])) field[2] = (s[1] - '0') * 6;
+      break;
+    }
+    if (*s == '#' || *s == '\0') break;
+    s++;
+  }
+  if (n < 2) return false;
+  secs = field[0] * 3600 + field[1] * 60 + field[2];
+  if (negative) secs = -secs;
+  return true;
+}
+
+static bool cachedSeconds(const char *cmd, int32_t &secs) {
+  char reply[LX200_REPLY_MAX_LEN + 1];
+  return cacheLookup(cmd, reply) != 0 && parseSexagesimal(reply, secs);
+}
+
+bool prefetchPosition(PrefetchPosition &pos) {
+  int32_t ra, dec, alt, az;
+  if (!cachedSeconds(":GR#", ra) || !cachedSeconds(":GD#", dec)) return false;
+  pos.ra = (uint32_t)(((uint64_t)ra << 32) / TIME_SECONDS);
+  pos.dec = (int32_t)((int64_t)dec * (1 << 30) / QUARTER_ARCSEC);
+
+  pos.hasAltAz = cachedSeconds(":GA#", alt) && cachedSeconds(":GZ#", az);
+  pos.alt = pos.hasAltAz ? (int32_t)((int64_t)alt * (1 << 30) / QUARTER_ARCSEC) : 0;
+  pos.az = pos.hasAltAz ? (uint32_t)(((uint64_t)az << 32) / CIRCLE_ARCSEC) : 0;
+
+  char reply[LX200_REPLY_MAX_LEN + 1];
+  pos.slewing = cacheLookup(":D#", reply) > 1;
+  return true;
+}
+
+// ============== Prefetch Service ========================
+// Returns true if it did any work.
+bool prefetchService() {
+  bool busy = collectPrefetch();
+
+  // Nobody to serve, leave the Teensy alone. Stellarium clients and the
+  // position broadcast are only ever sent what this polls, so they keep
+  // it running either way.
+  if ((!PREFETCH_ENABLE || lx200ClientCount() == 0) && stellariumClientCount() == 0 && !broadcastActive()) {
+    if (active) {
+      active = false;
+      cacheSetPositionTtl(CACHE_POSITION_TTL_MS);
+    }
+    return busy;
+  }
+  active = true;
+
+  unsigned long now = millis();
+  bool fast = manualMove || (long)(fastUntil - now) > 0;
+  unsigned long period = fast ? PREFETCH_MOTION_MS : PREFETCH_TRACKING_MS;
+  cacheSetPositionTtl(period + PREFETCH_TTL_SLACK_MS);
+
+  if (!refreshNow && now - lastCycle < period) return busy;
+
+  // A poll a client already has on the link fills the cache just as well
+  for (uint8_t i = 0; i < PREFETCH_COUNT; i++) {
+    if (tickets[i] != TEENSY_NO_TICKET || cacheFilling(prefetchCmds[i])) continue;
+    tickets[i] = teensySubmit(prefetchCmds[i], replies[i]);
+    if (tickets[i] == TEENSY_NO_TICKET) return busy;  // link full, finish the cycle later
+    cacheMarkFilling(prefetchCmds[i]);
+    busy = true;
+  }
+  lastCycle = now;
+  refreshNow = false;
+  return busy;
+}
@@ -0,0 +1,39 @@
+#ifndef TELEMETRY_PREFETCH_H
+#define TELEMETRY_PREFETCH_H
+
+#include <Arduino.h>
+#include "LX200Commands.h"
+
+// Background telemetry prefetcher. While at least one client is connected
+// it polls RA/Dec/Alt/Az and the slew status (:D#) into the response cache
+// itself, so client position polls are answered without a UART round-trip.
+// It is also the only source of the positions pushed to Stellarium
+// clients (see StellariumServer.h) and broadcast over UDP (see
+// PositionBroadcast.h, if enabled), which run it even with PREFETCH_ENABLE off.
+//
+// Polling is fast (PREFETCH_MOTION_MS) while a goto or a manual move is in
+// progress and for PREFETCH_MOTION_HOLD_MS after it stops, otherwise slow
+// (PREFETCH_TRACKING_MS). The cached position TTL is stretched to the
+// current period so a snapshot stays valid until the next one arrives.
+
+// Latest prefetched position as binary angles: a full circle is
+// 0x100000000 (RA, azimuth), 90 degrees is 0x40000000 (Dec, altitude)
+struct PrefetchPosition {
+  uint32_t ra;
+  int32_t dec;
+  int32_t alt;
+  uint32_t az;
+  bool hasAltAz;  // alt and az are valid
+  bool slewing;   // :D# showed a goto in progress
+};
+
+void prefetchBegin();
+bool prefetchService();
+
+// A client command moved or stopped the mount
+void prefetchNoteMotion(LX200Motion motion);
+
+// From the response cache, false while there is no current RA/Dec
+bool prefetchPosition(PrefetchPosition &pos);
+
+#endif // TELEMETRY_PREFETCH_H
@@ -0,0 +1,120 @@
+// Baud negotiation against the fake Teensy: stepping up through the trial
+// rates, and falling back to the base rate each time the Teensy reboots
+// while polls are timing out at a raised one.
+//   pio test -e native -f test_baud
+
+#include <unity.h>
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "BridgeConfig.h"
+#include "LX200Server.h"
+
+#define REBOOT_MS     10000  // fake Teensy reboot period
+#define RECOVER_MS    10000  // lost replies, session and fallback take this long at most
+
+void setup();
+void loop();
+
+static int client = -1;
+static bool badRate = false;  // the link ran at a rate not in its table
+static unsigned long lowestRate = 0;
+
+// One pass of the sketch, watching the link rate
+static void step() {
+  loop();
+  unsigned long baud = Serial1.baudRate_();
+  badRate |= baud != TEENSY_BAUD_BASE && baud != 460800 && baud != 921600 && baud != 2000000;
+  if (baud < lowestRate) lowestRate = baud;
+}
+
+static void pump(unsigned long ms) {
+  unsigned long start = millis();
+  while (millis() - start < ms) step();
+}
+
+// Sends cmd and runs the bridge until a '#' comes back or ms have passed
+static std::string poll(const char *cmd, unsigned long ms) {
+  send(client, cmd, strlen(cmd), 0);
+  std::string got;
+  unsigned long start = millis();
+  while (millis() - start < ms && got.find('#') == std::string::npos) {
+    step();
+    char buf[64];
+    ssize_t n = recv(client, buf, sizeof(buf), 0);
+    if (n > 0) got.append(buf, n);
+  }
+  return got;
+}
+
+// Polls through the next reboot until the link has been back on the base
+// rate
+static void pollThroughReboot() {
+  unsigned long start = millis();
+  lowestRate = Serial1.baudRate_();
+  while (millis() - start < REBOOT_MS + RECOVER_MS && lowestRate != TEENSY_BAUD_BASE) {
+    poll(":GD#", 50);
+  }
+  TEST_ASSERT_EQUAL(TEENSY_BAUD_BASE, lowestRate);
+}
+
+// Runs the bridge until the link settles at baud, then checks it answers
+static void settleAt(unsigned long baud) {
+  unsigned long start = millis();
+  while (millis() - start < 3000 && Serial1.baudRate_() != baud) step();
+  pump(1000);
+  TEST_ASSERT_EQUAL(baud, Serial1.baudRate_());
+
+  char stray[256];  // late replies to polls of the fallback
+  while (recv(client, stray, sizeof(stray), 0) > 0) {}
+  TEST_ASSERT_EQUAL_STRING("+45*30:15#", poll(":GD#", 500).c_str());
+  TEST_ASSERT_FALSE(badRate);
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_steps_up_to_clean_rate() {
+  // 2000000 fails its probe burst and the Teensy reverts by itself
+  settleAt(921600);
+}
+
+static void test_falls_back_after_reboot() {
+  // The lost rate is not tried again
+  pollThroughReboot();
+  settleAt(460800);
+}
+
+static void test_falls_back_again() {
+  // Errors counted before the first fallback must not step the base rate
+  // down
+  pollThroughReboot();
+  settleAt(TEENSY_BAUD_BASE);
+}
+
+int main() {
+  char reboot[16];
+  snprintf(reboot, sizeof(reboot), "%d", REBOOT_MS);
+  setenv("FAKE_TEENSY_REBOOT_MS", reboot, 1);
+  setup();
+  pump(1500);  // session and baud negotiated
+
+  client = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(LX200_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(client, (sockaddr *)&addr, sizeof(addr)) != 0) return 1;
+  fcntl(client, F_SETFL, O_NONBLOCK);
+  pump(50);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_steps_up_to_clean_rate);
+  RUN_TEST(test_falls_back_after_reboot);
+  RUN_TEST(test_falls_back_again);
+  return UNITY_END();
+}
@@ -0,0 +1,95 @@
+// ResponseCache: TTLs, invalidation and fills in flight
+//   pio test -e native -f test_cache
+
+#include <unity.h>
+#include "ResponseCache.h"
+#include "BridgeConfig.h"
+#include "LX200Framer.h"
+
+static char resp[LX200_REPLY_MAX_LEN + 1];
+
+void setUp() {
+  cacheBegin();
+  cacheSetPositionTtl(CACHE_POSITION_TTL_MS);
+}
+void tearDown() {}
+
+static void fill(const char *cmd, const char *reply) {
+  cacheMarkFilling(cmd);
+  cacheStore(cmd, reply, strlen(reply));
+}
+
+static void test_position_hit_then_expire() {
+  cacheSetPositionTtl(20);
+  fill(":GR#", "12:34:56#");
+  TEST_ASSERT_EQUAL(9, cacheLookup(":GR#", resp));
+  TEST_ASSERT_EQUAL_STRING("12:34:56#", resp);
+  delay(25);
+  TEST_ASSERT_EQUAL(0, cacheLookup(":GR#", resp));
+}
+
+static void test_setting_kept_until_invalidated() {
+  fill(":Gt#", "+45*00#");
+  delay(CACHE_POSITION_TTL_MS + 5);
+  TEST_ASSERT_EQUAL(7, cacheLookup(":Gt#", resp));
+  cacheInvalidate();
+  TEST_ASSERT_EQUAL(0, cacheLookup(":Gt#", resp));
+}
+
+static void test_uncacheable_not_kept() {
+  fill(":GL#", "21:30:00#");
+  TEST_ASSERT_EQUAL(0, cacheLookup(":GL#", resp));
+}
+
+static void test_store_needs_fill() {
+  cacheStore(":GD#", "+45*30:15#", 10);
+  TEST_ASSERT_EQUAL(0, cacheLookup(":GD#", resp));
+}
+
+static void test_filling_shared() {
+  cacheMarkFilling(":GD#");
+  TEST_ASSERT_TRUE(cacheFilling(":GD#"));
+  TEST_ASSERT_FALSE(cacheFilling(":GA#"));
+  cacheAbort(":GD#");
+  TEST_ASSERT_FALSE(cacheFilling(":GD#"));
+}
+
+static void test_fill_across_invalidate_dropped() {
+  // The mount moved while the reply was on its way
+  cacheMarkFilling(":GR#");
+  cacheInvalidate();
+  cacheStore(":GR#", "12:34:56#", 9);
+  TEST_ASSERT_FALSE(cacheFilling(":GR#"));
+  TEST_ASSERT_EQUAL(0, cacheLookup(":GR#", resp));
+}
+
+static void test_unterminated_reply_dropped() {
+  fill(":GR#", "12:34:5");
+  TEST_ASSERT_EQUAL(0, cacheLookup(":GR#", resp));
+}
+
+static void test_oldest_evicted() {
+  char cmd[CACHE_KEY_MAX];
+  fill(":GR#", "12:34:56#");
+  delay(2);
+  fill(":Gt#", "+45*00#");
+  for (uint8_t i = 0; i < CACHE_ENTRIES - 1; i++) {
+    snprintf(cmd, sizeof(cmd), ":X%c#", 'a' + i);
+    fill(cmd, "1#");
+  }
+  TEST_ASSERT_EQUAL(0, cacheLookup(":GR#", resp));
+  TEST_ASSERT_EQUAL(7, cacheLookup(":Gt#", resp));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_position_hit_then_expire);
+  RUN_TEST(test_setting_kept_until_invalidated);
+  RUN_TEST(test_uncacheable_not_kept);
+  RUN_TEST(test_store_needs_fill);
+  RUN_TEST(test_filling_shared);
+  RUN_TEST(test_fill_across_invalidate_dropped);
+  RUN_TEST(test_unterminated_reply_dropped);
+  RUN_TEST(test_oldest_evicted);
+  return UNITY_END();
+}
@@ -0,0 +1,153 @@
+// SessionCapture: record merging, the ring and the dump format
+//   pio test -e native -f test_capture
+
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "SessionCapture.h"
+
+class StringPrint : public Print {
+  public:
+    std::string text;
+    size_t write(uint8_t c) override {
+      text += (char)c;
+      return 1;
+    }
+};
+
+// Dumps everything captured, one entry per line with the micros() dropped
+static std::vector<std::string> dump() {
+  StringPrint out;
+  captureDump();
+  while (captureDrain(out, 4)) {}
+
+  std::vector<std::string> lines;
+  size_t start = 0;
+  while (start < out.text.size()) {
+    size_t nl = out.text.find('\n', start);
+    std::string line = out.text.substr(start, nl - start);
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line[0] != '#') line = line.substr(line.find(' ') + 1);
+    lines.push_back(line);
+    start = nl + 1;
+  }
+  return lines;
+}
+
+static void record(CaptureDir dir, uint8_t peer, const char *s) {
+  captureRecord(dir, peer, s, strlen(s));
+}
+
+void setUp() {}
+void tearDown() {
+  dump();  // empty for the next test
+}
+
+static void test_dump_format() {
+  record(CAP_CONNECT, 1, "");
+  record(CAP_CLIENT_IN, 1, ":GR#");
+  record(CAP_TEENSY_OUT, 0, ":GR#");
+  record(CAP_TEENSY_IN, 0, "12:34:56#");
+  record(CAP_CLIENT_OUT, 1, "12:34:56#");
+  record(CAP_DISCONNECT, 1, "");
+
+  std::vector<std::string> lines = dump();
+  TEST_ASSERT_EQUAL(8, lines.size());
+  TEST_ASSERT_EQUAL_STRING("# lx200 capture 1", lines[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("+C1 ", lines[1].c_str());
+  TEST_ASSERT_EQUAL_STRING(">C1 :GR#", lines[2].c_str());
+  TEST_ASSERT_EQUAL_STRING("<T :GR#", lines[3].c_str());
+  TEST_ASSERT_EQUAL_STRING(">T 12:34:56#", lines[4].c_str());
+  TEST_ASSERT_EQUAL_STRING("<C1 12:34:56#", lines[5].c_str());
+  TEST_ASSERT_EQUAL_STRING("-C1 ", lines[6].c_str());
+  TEST_ASSERT_EQUAL_STRING("# end", lines[7].c_str());
+}
+
+static void test_bytes_escaped() {
+  const uint8_t raw[] = { 'a', ' ', 'b', '\\', 0x06, 0xA5, '#' };
+  captureRecord(CAP_TEENSY_IN, 0, raw, sizeof(raw));
+  TEST_ASSERT_EQUAL_STRING(">T a\\x20b\\x5C\\x06\\xA5#", dump()[1].c_str());
+}
+
+static void test_continuation_merged() {
+  // A reply read a byte at a time is one record
+  record(CAP_TEENSY_IN, 0, "12:");
+  record(CAP_TEENSY_IN, 0, "34:");
+  record(CAP_TEENSY_IN, 0, "56#");
+  record(CAP_CLIENT_IN, 2, ":GD#");
+  record(CAP_CLIENT_IN, 3, ":GD#");  // another client
+  delay(2);
+  record(CAP_CLIENT_IN, 3, ":GD#");  // later
+
+  std::vector<std::string> lines = dump();
+  TEST_ASSERT_EQUAL(6, lines.size());
+  TEST_ASSERT_EQUAL_STRING(">T 12:34:56#", lines[1].c_str());
+  TEST_ASSERT_EQUAL_STRING(">C2 :GD#", lines[2].c_str());
+  TEST_ASSERT_EQUAL_STRING(">C3 :GD#", lines[3].c_str());
+  TEST_ASSERT_EQUAL_STRING(">C3 :GD#", lines[4].c_str());
+}
+
+static void test_long_record_split() {
+  // Over 255 bytes takes two records, each printed 24 bytes a line
+  std::string data;
+  for (int i = 0; i < 300; i++) data += (char)('a' + i % 26);
+  record(CAP_CLIENT_OUT, 0, data.c_str());
+
+  std::vector<std::string> lines = dump();
+  std::string joined;
+  for (size_t i = 1; i + 1 < lines.size(); i++) {
+    TEST_ASSERT_EQUAL_STRING("<C0 ", lines[i].substr(0, 4).c_str());
+    TEST_ASSERT_TRUE(lines[i].size() <= 4 + 24);
+    joined += lines[i].substr(4);
+  }
+  TEST_ASSERT_EQUAL(11 + 2 + 2, lines.size());  // 255 bytes in 11 lines, 45 in 2
+  TEST_ASSERT_EQUAL_STRING(data.c_str(), joined.c_str());
+}
+
+static void test_ring_keeps_latest() {
+  char cmd[16];
+  int n = 0;
+  for (size_t bytes = 0; bytes < 2 * CAPTURE_BUF_BYTES; bytes += 16) {
+    snprintf(cmd, sizeof(cmd), ":Sr%05d#", n++);
+    record(n % 2 ? CAP_CLIENT_IN : CAP_TEENSY_OUT, 0, cmd);  // never merged
+  }
+
+  std::vector<std::string> lines = dump();
+  TEST_ASSERT_EQUAL('#', lines[1][0]);
+  TEST_ASSERT_TRUE(lines[1].find("older records dropped") != std::string::npos);
+  TEST_ASSERT_TRUE(lines.size() > 3);
+  snprintf(cmd, sizeof(cmd), ":Sr%05d#", n - 1);
+  TEST_ASSERT_TRUE(lines[lines.size() - 2].find(cmd) != std::string::npos);
+  TEST_ASSERT_TRUE(lines.size() - 3 <= CAPTURE_BUF_BYTES / 16);  // 16 bytes a record
+
+  // Dropped is counted once
+  record(CAP_CLIENT_IN, 0, ":GR#");
+  TEST_ASSERT_EQUAL(3, dump().size());
+}
+
+static void test_drain_bounded() {
+  for (int i = 0; i < 10; i++) {
+    record(i % 2 ? CAP_CLIENT_IN : CAP_TEENSY_OUT, 0, ":GR#");
+  }
+  StringPrint out;
+  TEST_ASSERT_FALSE(captureDrain(out, 4));  // nothing asked for
+  captureDump();
+  TEST_ASSERT_TRUE(captureDrain(out, 4));  // header
+  TEST_ASSERT_TRUE(captureDrain(out, 4));
+  TEST_ASSERT_TRUE(captureDrain(out, 4));
+  TEST_ASSERT_TRUE(out.text.find("# end") == std::string::npos);
+  TEST_ASSERT_TRUE(captureDrain(out, 4));
+  TEST_ASSERT_TRUE(out.text.find("# end") != std::string::npos);
+  TEST_ASSERT_FALSE(captureDrain(out, 4));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_dump_format);
+  RUN_TEST(test_bytes_escaped);
+  RUN_TEST(test_continuation_merged);
+  RUN_TEST(test_long_record_split);
+  RUN_TEST(test_ring_keeps_latest);
+  RUN_TEST(test_drain_bounded);
+  return UNITY_END();
+}
@@ -0,0 +1,81 @@
+// LX200Commands: opcode keys and the perfect hash lookup
+//   pio test -e native -f test_commands
+
+#include <unity.h>
+#include "LX200Commands.h"
+
+void setUp() {}
+void tearDown() {}
+
+static void test_opcode_key() {
+  TEST_ASSERT_EQUAL(lx200OpKey("GR"), lx200CmdKey(":GR#"));
+  TEST_ASSERT_EQUAL(lx200OpKey("GVP"), lx200CmdKey(":GVP#"));
+  TEST_ASSERT_EQUAL(lx200OpKey("Q"), lx200CmdKey(":Q#"));
+  TEST_ASSERT_EQUAL(lx200OpKey("Sr"), lx200CmdKey(":Sr12:34:56#"));
+  TEST_ASSERT_EQUAL(lx200OpKey("SG"), lx200CmdKey(":SG+06.0#"));
+  TEST_ASSERT_EQUAL(0, lx200CmdKey("GR#"));
+}
+
+static void test_known_commands() {
+  static const char *const cmds[] = {
+    ":GVP#", ":GVN#", ":XH#", ":GR#", ":GD#", ":GA#", ":GZ#", ":GW#", ":D#",
+    ":Gc#", ":GS#", ":Sr12:34:56#", ":Sd+45*30:00#", ":SG+06.0#", ":SC05/25/25#",
+    ":MS#", ":MA#", ":CM#", ":Me#", ":Q#", ":Qe#", ":RC#", ":Te#", ":hP#", ":hC#"
+  };
+  for (const char *cmd : cmds) {
+    TEST_ASSERT_TRUE_MESSAGE(lx200Lookup(cmd).key == lx200CmdKey(cmd), cmd);
+  }
+}
+
+static void test_descriptors() {
+  TEST_ASSERT_EQUAL_STRING("On-Step#", lx200Lookup(":GVP#").localReply);
+  TEST_ASSERT_EQUAL_STRING("A", lx200Lookup("\x06").localReply);
+  TEST_ASSERT_EQUAL(LX200_QUERY_STATS, lx200Lookup(":XH#").query);
+  TEST_ASSERT_EQUAL(LX200_CACHE_POSITION, lx200Lookup(":GR#").cache);
+  TEST_ASSERT_EQUAL(LX200_CACHE_SETTING, lx200Lookup(":Gt#").cache);
+  TEST_ASSERT_EQUAL(LX200_SHAPE_CHAR, lx200Lookup(":MS#").shape);
+  TEST_ASSERT_EQUAL(LX200_BATCH_COMMIT, lx200Lookup(":MS#").batch);
+  TEST_ASSERT_EQUAL(LX200_SHAPE_CHAR, lx200Lookup(":MA#").shape);  // a digit, like :MS#
+  TEST_ASSERT_EQUAL(LX200_BATCH_HOLD, lx200Lookup(":Sr12:34:56#").batch);
+  TEST_ASSERT_EQUAL(LX200_REWRITE_TZ_DECIMAL, lx200Lookup(":SG+06.0#").rewrite);
+  TEST_ASSERT_EQUAL(LX200_MOTION_STOP, lx200Lookup(":Q#").motion);
+  TEST_ASSERT_EQUAL(LX200_MOTION_MOVE, lx200Lookup(":Mw#").motion);
+  TEST_ASSERT_EQUAL(LX200_SHAPE_NONE, lx200Lookup(":Mw#").shape);
+}
+
+static void test_unknown_commands() {
+  // Not in the table: alone on the wire, and only gets keep the cache
+  const LX200CmdDesc &get = lx200Lookup(":GX99#");
+  TEST_ASSERT_EQUAL(0, get.key);
+  TEST_ASSERT_EQUAL(LX200_SHAPE_UNKNOWN, get.shape);
+  TEST_ASSERT_FALSE(get.invalidatesCache);
+
+  const LX200CmdDesc &cmd = lx200Lookup(":$QZ+#");
+  TEST_ASSERT_EQUAL(0, cmd.key);
+  TEST_ASSERT_EQUAL(LX200_SHAPE_UNKNOWN, cmd.shape);
+  TEST_ASSERT_TRUE(cmd.invalidatesCache);
+
+  // Near misses of known opcodes
+  TEST_ASSERT_EQUAL(0, lx200Lookup(":GRX#").key);
+  TEST_ASSERT_EQUAL(0, lx200Lookup(":Z#").key);
+}
+
+static void test_link_control_refused() {
+  // Only the bridge may change the session, rate or framing of the link
+  static const char *const cmds[] = { ":XS#", ":XB460800#", ":XE0123#", ":XC#", ":XF#" };
+  for (const char *cmd : cmds) {
+    const LX200CmdDesc &d = lx200Lookup(cmd);
+    TEST_ASSERT_TRUE_MESSAGE(d.key == lx200CmdKey(cmd), cmd);
+    TEST_ASSERT_EQUAL_STRING("0", d.localReply);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_opcode_key);
+  RUN_TEST(test_known_commands);
+  RUN_TEST(test_descriptors);
+  RUN_TEST(test_unknown_commands);
+  RUN_TEST(test_link_control_refused);
+  return UNITY_END();
+}
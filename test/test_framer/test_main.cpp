@@ -0,0 +1,84 @@
+// LX200Framer: client bytes to complete commands
+//   pio test -e native -f test_framer
+
+#include <unity.h>
+#include "LX200Framer.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Feeds s, returns the number of complete commands, the last one in last
+static int feedAll(LX200Framer &f, const char *s, char *last) {
+  int n = 0;
+  for (; *s != '\0'; s++) {
+    if (f.feed(*s) == LX200_FRAME_COMMAND) {
+      strcpy(last, f.command().data);
+      n++;
+    }
+  }
+  return n;
+}
+
+static void test_single_command() {
+  LX200Framer f;
+  char last[LX200_CMD_MAX_LEN + 1] = "";
+  TEST_ASSERT_EQUAL(1, feedAll(f, ":GR#", last));
+  TEST_ASSERT_EQUAL_STRING(":GR#", last);
+  TEST_ASSERT_EQUAL(4, f.command().len);
+}
+
+static void test_noise_between_commands() {
+  // Stellarium Mobile puts '#' in front of ':'
+  LX200Framer f;
+  char last[LX200_CMD_MAX_LEN + 1] = "";
+  TEST_ASSERT_EQUAL(2, feedAll(f, "##:GR#\r\n x#:Sr12:34:56#", last));
+  TEST_ASSERT_EQUAL_STRING(":Sr12:34:56#", last);
+}
+
+static void test_ack() {
+  LX200Framer f;
+  TEST_ASSERT_EQUAL(LX200_FRAME_ACK, f.feed(LX200_ACK));
+  // Also inside a command, without breaking it
+  char last[LX200_CMD_MAX_LEN + 1] = "";
+  feedAll(f, ":G", last);
+  TEST_ASSERT_EQUAL(LX200_FRAME_ACK, f.feed(LX200_ACK));
+  TEST_ASSERT_EQUAL(1, feedAll(f, "D#", last));
+  TEST_ASSERT_EQUAL_STRING(":GD#", last);
+}
+
+static void test_too_long_dropped() {
+  LX200Framer f;
+  char junk[LX200_CMD_MAX_LEN + 8];
+  memset(junk, 'x', sizeof(junk) - 1);
+  junk[0] = ':';
+  junk[sizeof(junk) - 1] = '\0';
+
+  char last[LX200_CMD_MAX_LEN + 1] = "";
+  TEST_ASSERT_EQUAL(0, feedAll(f, junk, last));
+  TEST_ASSERT_EQUAL(0, feedAll(f, "#", last));
+  TEST_ASSERT_EQUAL(1, feedAll(f, ":GD#", last));
+  TEST_ASSERT_EQUAL_STRING(":GD#", last);
+}
+
+static void test_longest_command_kept() {
+  LX200Framer f;
+  char cmd[LX200_CMD_MAX_LEN + 1];
+  memset(cmd, '1', LX200_CMD_MAX_LEN);
+  cmd[0] = ':';
+  cmd[LX200_CMD_MAX_LEN - 1] = '#';
+  cmd[LX200_CMD_MAX_LEN] = '\0';
+
+  char last[LX200_CMD_MAX_LEN + 1] = "";
+  TEST_ASSERT_EQUAL(1, feedAll(f, cmd, last));
+  TEST_ASSERT_EQUAL_STRING(cmd, last);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_single_command);
+  RUN_TEST(test_noise_between_commands);
+  RUN_TEST(test_ack);
+  RUN_TEST(test_too_long_dropped);
+  RUN_TEST(test_longest_command_kept);
+  return UNITY_END();
+}
@@ -0,0 +1,124 @@
+// TeensyFrames: CRC, packing and frame reassembly
+//   pio test -e native -f test_frames
+
+#include <unity.h>
+#include "TeensyFrames.h"
+#include "LX200Framer.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Feeds a whole frame, returns the last result
+static FrameResult feedFrame(FrameParser &p, const uint8_t *buf, size_t len) {
+  FrameResult r = FRAME_NONE;
+  for (size_t i = 0; i < len; i++) r = p.feed(buf[i]);
+  return r;
+}
+
+static void test_crc16_ccitt_false() {
+  TEST_ASSERT_EQUAL_HEX16(0x29B1, frameCrc16((const uint8_t *)"123456789", 9));
+  TEST_ASSERT_EQUAL_HEX16(0xFFFF, frameCrc16(nullptr, 0));
+}
+
+// Bridge encodes, Teensy decodes
+static void checkCommand(const char *cmd, size_t expectLen) {
+  uint8_t buf[FRAME_MAX_LEN];
+  size_t len = frameEncodeCommand(cmd, 45, buf);
+  TEST_ASSERT_EQUAL(expectLen, len);
+
+  FrameParser p;
+  TEST_ASSERT_EQUAL(FRAME_OK, feedFrame(p, buf, len));
+  TEST_ASSERT_EQUAL(45, p.seq());
+
+  char text[LX200_CMD_MAX_LEN + 1];
+  TEST_ASSERT_TRUE(frameDecodeCommand(p.payload(), p.len(), text, sizeof(text)));
+  TEST_ASSERT_EQUAL_STRING(cmd, text);
+}
+
+static void test_command_round_trip() {
+  checkCommand(":GR#", FRAME_OVERHEAD + 1);
+  checkCommand(":Sr12:34:56#", FRAME_OVERHEAD + 4);   // packed
+  checkCommand(":Sd-05*06:07#", FRAME_OVERHEAD + 4);  // packed, sign kept
+  checkCommand(":Sr1:2:3#", FRAME_OVERHEAD + 8);      // wrong format, as text
+  checkCommand(":GVP#", FRAME_OVERHEAD + 4);          // not in the frame table
+}
+
+// Teensy encodes, bridge decodes
+static void checkReply(const char *cmd, const char *reply, bool packed) {
+  uint8_t buf[FRAME_MAX_LEN];
+  size_t len = frameEncodeReply(cmd, reply, 7, buf);
+
+  FrameParser p;
+  TEST_ASSERT_EQUAL(FRAME_OK, feedFrame(p, buf, len));
+  TEST_ASSERT_EQUAL(7, p.seq());
+  TEST_ASSERT_EQUAL(packed, p.packed());
+
+  char text[LX200_REPLY_MAX_LEN + 1];
+  uint8_t n = frameDecodeReply(cmd, p.packed(), p.payload(), p.len(), text, LX200_REPLY_MAX_LEN);
+  TEST_ASSERT_EQUAL(strlen(reply), n);
+  TEST_ASSERT_EQUAL_STRING(reply, text);
+}
+
+static void test_reply_round_trip() {
+  checkReply(":GR#", "12:34:56#", true);
+  checkReply(":GD#", "-45*30:15#", true);
+  checkReply(":GZ#", "359*59:59#", true);
+  checkReply(":GR#", "12:34.5#", false);  // low precision stays text
+  checkReply(":GW#", "AT1#", false);
+  checkReply(":MS#", "0", false);
+  checkReply(":Q#", "", false);
+}
+
+static void test_packed_reply_size() {
+  uint8_t buf[FRAME_MAX_LEN];
+  TEST_ASSERT_EQUAL(FRAME_OVERHEAD + 3, frameEncodeReply(":GR#", "12:34:56#", 0, buf));
+  TEST_ASSERT_EQUAL(FRAME_OVERHEAD + 4, frameEncodeReply(":GZ#", "180*45:30#", 0, buf));
+}
+
+static void test_corrupt_frame_bad() {
+  uint8_t buf[FRAME_MAX_LEN];
+  size_t len = frameEncodeReply(":GR#", "12:34:56#", 3, buf);
+  FrameParser p;
+
+  for (size_t i = 0; i < len; i++) {
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      uint8_t bad[FRAME_MAX_LEN];
+      memcpy(bad, buf, len);
+      bad[i] ^= 1 << bit;
+      // A flipped head bit or length leaves the frame unfinished or cut
+      // short, never good
+      FrameResult r = feedFrame(p, bad, len);
+      TEST_ASSERT_TRUE(r != FRAME_OK);
+      p.reset();
+    }
+  }
+  TEST_ASSERT_EQUAL(FRAME_OK, feedFrame(p, buf, len));
+}
+
+static void test_resync_after_noise() {
+  uint8_t buf[FRAME_MAX_LEN];
+  size_t len = frameEncodeReply(":GW#", "AT1#", 9, buf);
+  FrameParser p;
+
+  const uint8_t noise[] = { 'x', '#', 0x00, 0x7F };
+  TEST_ASSERT_EQUAL(FRAME_NONE, feedFrame(p, noise, sizeof(noise)));
+  TEST_ASSERT_FALSE(p.inFrame());
+  TEST_ASSERT_EQUAL(FRAME_OK, feedFrame(p, buf, len));
+  TEST_ASSERT_EQUAL(9, p.seq());
+
+  // An impossible length is bad straight away
+  const uint8_t tooLong[] = { FRAME_HEAD, FRAME_MAX_PAYLOAD + 1 };
+  TEST_ASSERT_EQUAL(FRAME_BAD, feedFrame(p, tooLong, sizeof(tooLong)));
+  TEST_ASSERT_FALSE(p.inFrame());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_crc16_ccitt_false);
+  RUN_TEST(test_command_round_trip);
+  RUN_TEST(test_reply_round_trip);
+  RUN_TEST(test_packed_reply_size);
+  RUN_TEST(test_corrupt_frame_bad);
+  RUN_TEST(test_resync_after_noise);
+  return UNITY_END();
+}
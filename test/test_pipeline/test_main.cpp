@@ -0,0 +1,148 @@
+// Whole bridge against the fake Teensy: an LX200 client on the native TCP
+// server, several commands in flight on the text link where replies are
+// matched in order. Also the regressions for reply routing, stop
+// preemption and held set failures. Frames are covered in test_frames.
+//   pio test -e native -f test_pipeline
+
+#include <unity.h>
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "LX200Server.h"
+
+#define REPLY_WAIT_MS   1500
+#define SETTLE_MS        150  // after the expected reply, for anything extra
+
+void setup();
+void loop();
+
+static int client = -1;
+
+static void pump(unsigned long ms) {
+  unsigned long start = millis();
+  while (millis() - start < ms) loop();
+}
+
+static int connectBridge() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(LX200_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  pump(50);  // accepted
+  return fd;
+}
+
+// Sends cmds and runs the bridge until expect has come back, then a little
+// longer so a stray extra reply shows up too
+static std::string exchange(const char *cmds, const char *expect) {
+  send(client, cmds, strlen(cmds), 0);
+  std::string got;
+  unsigned long start = millis();
+  unsigned long done = 0;
+  while (millis() - start < REPLY_WAIT_MS) {
+    loop();
+    char buf[128];
+    ssize_t n = recv(client, buf, sizeof(buf), 0);
+    if (n > 0) got.append(buf, n);
+    if (done == 0 && got.size() >= strlen(expect)) done = millis();
+    if (done != 0 && millis() - done >= SETTLE_MS) break;
+  }
+  return got;
+}
+
+void setUp() {
+  client = connectBridge();
+  TEST_ASSERT_TRUE(client >= 0);
+}
+
+void tearDown() {
+  close(client);
+  pump(100);  // dropped, and its held sets flushed
+}
+
+static void test_local_and_forwarded() {
+  TEST_ASSERT_EQUAL_STRING("On-Step#", exchange(":GVP#", "On-Step#").c_str());
+  TEST_ASSERT_EQUAL_STRING("+45*30:15#", exchange(":GD#", "+45*30:15#").c_str());
+}
+
+static void test_pipelined_in_order() {
+  const char *expect = "+45*30:15#+30*12:00#180*45:30#AT1#24#05/25/25#21:30:00#";
+  TEST_ASSERT_EQUAL_STRING(expect, exchange(":GD#:GA#:GZ#:GW#:Gc#:GC#:GL#", expect).c_str());
+}
+
+// A command not in the table answered with a bare "0" took the next
+// command's reply, and every later reply went to the wrong command
+static void test_unknown_command_keeps_routing() {
+  const char *expect = "010:15:00#21:30:00#24#";
+  TEST_ASSERT_EQUAL_STRING(expect, exchange(":GX99#:GS#:GL#:Gc#", expect).c_str());
+  TEST_ASSERT_EQUAL_STRING("10:15:00#", exchange(":GS#", "10:15:00#").c_str());
+}
+
+// A stop must not overtake the goto just before it, or the goto runs on
+static void test_stop_after_goto() {
+  TEST_ASSERT_EQUAL_STRING("0#1", exchange(":MS#:Q#", "0#1").c_str());
+  TEST_ASSERT_EQUAL_STRING("AT1#", exchange(":GW#", "AT1#").c_str());
+}
+
+// A rejected set refused the client's next goto long after it was settled
+static void test_rejected_set_not_sticky() {
+  TEST_ASSERT_EQUAL_STRING("1", exchange(":Sr25:00:00#", "1").c_str());
+  TEST_ASSERT_EQUAL(9, exchange(":GR#", "12:00:00#").size());
+  TEST_ASSERT_EQUAL_STRING("110#", exchange(":Sr10:00:00#:Sd+10*00:00#:MS#", "110#").c_str());
+  exchange(":Q#", "1");
+}
+
+// A goto whose held set was rejected is refused
+static void test_rejected_set_refuses_goto() {
+  std::string got = exchange(":Sr25:00:00#:Sd+10*00:00#:MS#", "11?");
+  TEST_ASSERT_EQUAL(3, got.size());
+  TEST_ASSERT_TRUE(got[2] != '0');
+  TEST_ASSERT_EQUAL_STRING("AT1#", exchange(":GW#", "AT1#").c_str());
+}
+
+// The 0x06 mount type query is answered in turn, not ahead of the reply
+// still owed for the command before it
+static void test_ack_in_order() {
+  const char *expect = "+45*30:15#A+30*12:00#";
+  TEST_ASSERT_EQUAL_STRING(expect, exchange(":GD#\x06:GA#", expect).c_str());
+}
+
+// Link control from a client never reaches the Teensy
+static void test_link_control_refused() {
+  unsigned long baud = Serial1.baudRate_();
+  const char *expect = "000+45*30:15#";
+  TEST_ASSERT_EQUAL_STRING(expect, exchange(":XB460800#:XC#:XS#:GD#", expect).c_str());
+  pump(300);  // past the Teensy's trial window
+  TEST_ASSERT_EQUAL_STRING("+45*30:15#", exchange(":GD#", "+45*30:15#").c_str());
+  TEST_ASSERT_EQUAL(baud, Serial1.baudRate_());
+}
+
+int main() {
+  setenv("FAKE_TEENSY_FRAMES", "0", 1);
+  setup();
+  pump(1500);  // session and baud negotiated
+
+  UNITY_BEGIN();
+  RUN_TEST(test_local_and_forwarded);
+  RUN_TEST(test_pipelined_in_order);
+  RUN_TEST(test_unknown_command_keeps_routing);
+  RUN_TEST(test_stop_after_goto);
+  RUN_TEST(test_rejected_set_not_sticky);
+  RUN_TEST(test_rejected_set_refuses_goto);
+  RUN_TEST(test_ack_in_order);
+  RUN_TEST(test_link_control_refused);
+  return UNITY_END();
+}
@@ -0,0 +1,122 @@
+// TelemetryPrefetch: cached position replies parsed into binary angles
+//   pio test -e native -f test_prefetch
+
+#include <unity.h>
+#include "TelemetryPrefetch.h"
+#include "ResponseCache.h"
+
+void setUp() {
+  cacheBegin();
+}
+void tearDown() {}
+
+static void fill(const char *cmd, const char *reply) {
+  cacheMarkFilling(cmd);
+  cacheStore(cmd, reply, strlen(reply));
+}
+
+// Position from a :GR#/:GD# pair, false if either didn't parse
+static bool position(const char *ra, const char *dec, PrefetchPosition &pos) {
+  cacheInvalidate();
+  fill(":GR#", ra);
+  fill(":GD#", dec);
+  return prefetchPosition(pos);
+}
+
+static uint32_t raAngle(uint32_t secs) {
+  return (uint32_t)(((uint64_t)secs << 32) / 86400);
+}
+
+static int32_t decAngle(int32_t arcsec) {
+  return (int32_t)((int64_t)arcsec * (1 << 30) / 324000);
+}
+
+static void test_nothing_cached() {
+  PrefetchPosition pos;
+  TEST_ASSERT_FALSE(prefetchPosition(pos));
+  fill(":GR#", "12:00:00#");
+  TEST_ASSERT_FALSE(prefetchPosition(pos));  // no Dec
+}
+
+static void test_high_precision() {
+  PrefetchPosition pos;
+  TEST_ASSERT_TRUE(position("06:00:00#", "+45*00:00#", pos));
+  TEST_ASSERT_EQUAL_HEX32(0x40000000, pos.ra);
+  TEST_ASSERT_EQUAL_HEX32(0x20000000, pos.dec);
+
+  TEST_ASSERT_TRUE(position("12:34:56#", "+45*30:15#", pos));
+  TEST_ASSERT_EQUAL_HEX32(raAngle(12 * 3600 + 34 * 60 + 56), pos.ra);
+  TEST_ASSERT_EQUAL(decAngle(45 * 3600 + 30 * 60 + 15), pos.dec);
+}
+
+static void test_negative_dec() {
+  PrefetchPosition pos;
+  TEST_ASSERT_TRUE(position("00:00:00#", "-45*30:15#", pos));
+  TEST_ASSERT_EQUAL(0, pos.ra);
+  TEST_ASSERT_EQUAL(-decAngle(45 * 3600 + 30 * 60 + 15), pos.dec);
+
+  // Below a degree the sign is all there is
+  TEST_ASSERT_TRUE(position("00:00:00#", "-00*30:00#", pos));
+  TEST_ASSERT_EQUAL(-decAngle(30 * 60), pos.dec);
+  TEST_ASSERT_TRUE(position("00:00:00#", "-90*00:00#", pos));
+  TEST_ASSERT_EQUAL(-0x40000000, pos.dec);
+}
+
+static void test_low_precision() {
+  PrefetchPosition pos;
+  TEST_ASSERT_TRUE(position("12:34.5#", "+45*30#", pos));
+  TEST_ASSERT_EQUAL_HEX32(raAngle(12 * 3600 + 34 * 60 + 30), pos.ra);  // tenths of a minute
+  TEST_ASSERT_EQUAL(decAngle(45 * 3600 + 30 * 60), pos.dec);
+}
+
+static void test_other_separators() {
+  // Only the digits matter, like OnStepX's ' and the degree sign
+  PrefetchPosition pos;
+  TEST_ASSERT_TRUE(position("12:34:56#", "+45\xDF" "30'15#", pos));
+  TEST_ASSERT_EQUAL(decAngle(45 * 3600 + 30 * 60 + 15), pos.dec);
+}
+
+static void test_malformed_rejected() {
+  PrefetchPosition pos;
+  TEST_ASSERT_FALSE(position("12#", "+45*30:15#", pos));
+  TEST_ASSERT_FALSE(position("ab:cd:ef#", "+45*30:15#", pos));
+  TEST_ASSERT_FALSE(position("12:34:56#", "+*30:15#", pos));
+  TEST_ASSERT_FALSE(position("12:34:56#", "0", pos));
+}
+
+static void test_alt_az_optional() {
+  PrefetchPosition pos;
+  TEST_ASSERT_TRUE(position("12:34:56#", "+45*30:15#", pos));
+  TEST_ASSERT_FALSE(pos.hasAltAz);
+
+  fill(":GA#", "+30*12:00#");
+  fill(":GZ#", "180*45:30#");
+  TEST_ASSERT_TRUE(prefetchPosition(pos));
+  TEST_ASSERT_TRUE(pos.hasAltAz);
+  TEST_ASSERT_EQUAL(decAngle(30 * 3600 + 12 * 60), pos.alt);
+  TEST_ASSERT_EQUAL_HEX32((uint32_t)(((uint64_t)(180 * 3600 + 45 * 60 + 30) << 32) / 1296000), pos.az);
+}
+
+static void test_slewing_from_status() {
+  PrefetchPosition pos;
+  position("12:34:56#", "+45*30:15#", pos);
+  fill(":D#", "#");
+  TEST_ASSERT_TRUE(prefetchPosition(pos));
+  TEST_ASSERT_FALSE(pos.slewing);
+  fill(":D#", "\x7f#");
+  TEST_ASSERT_TRUE(prefetchPosition(pos));
+  TEST_ASSERT_TRUE(pos.slewing);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_nothing_cached);
+  RUN_TEST(test_high_precision);
+  RUN_TEST(test_negative_dec);
+  RUN_TEST(test_low_precision);
+  RUN_TEST(test_other_separators);
+  RUN_TEST(test_malformed_rejected);
+  RUN_TEST(test_alt_az_optional);
+  RUN_TEST(test_slewing_from_status);
+  return UNITY_END();
+}
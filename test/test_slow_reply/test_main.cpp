@@ -0,0 +1,87 @@
+// A slow reply on the text link, well past the learned window: the wait
+// backs off instead of giving the reply up, so the session, the commands
+// in flight and the baud rate all survive it.
+//   pio test -e native -f test_slow_reply
+
+#include <unity.h>
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "LX200Server.h"
+#include "TeensyLink.h"
+
+#define SLOW_EVERY   25
+#define POLL_MS    4000
+
+void setup();
+void loop();
+
+static int client = -1;
+static bool sessionLost = false;
+
+static void step() {
+  loop();
+  sessionLost |= !teensySessionActive();
+}
+
+static void pump(unsigned long ms) {
+  unsigned long start = millis();
+  while (millis() - start < ms) step();
+}
+
+// Sends cmd and runs the bridge until a '#' comes back or ms have passed
+static std::string poll(const char *cmd, unsigned long ms) {
+  send(client, cmd, strlen(cmd), 0);
+  std::string got;
+  unsigned long start = millis();
+  while (millis() - start < ms && got.find('#') == std::string::npos) {
+    step();
+    char buf[64];
+    ssize_t n = recv(client, buf, sizeof(buf), 0);
+    if (n > 0) got.append(buf, n);
+  }
+  return got;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_slow_reply_not_lost() {
+  unsigned long baud = Serial1.baudRate_();
+  unsigned long start = millis();
+  int polls = 0;
+  while (millis() - start < POLL_MS) {
+    TEST_ASSERT_EQUAL_STRING("21:30:00#", poll(":GL#", 1000).c_str());
+    polls++;
+  }
+  TEST_ASSERT_TRUE(polls > 2 * SLOW_EVERY);  // several slow replies among them
+  TEST_ASSERT_FALSE(sessionLost);
+  TEST_ASSERT_EQUAL(baud, Serial1.baudRate_());
+}
+
+int main() {
+  char every[16];
+  snprintf(every, sizeof(every), "%d", SLOW_EVERY);
+  setenv("FAKE_TEENSY_FRAMES", "0", 1);
+  setenv("FAKE_TEENSY_SLOW_EVERY", every, 1);
+  setup();
+  pump(1500);  // session and baud negotiated
+
+  client = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(LX200_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(client, (sockaddr *)&addr, sizeof(addr)) != 0) return 1;
+  fcntl(client, F_SETFL, O_NONBLOCK);
+  pump(50);
+  sessionLost = !teensySessionActive();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_slow_reply_not_lost);
+  return UNITY_END();
+}
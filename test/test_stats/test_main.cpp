@@ -0,0 +1,102 @@
+// BridgeStats: histogram buckets, percentiles and the :XH# summary
+//   pio test -e native -f test_stats
+
+#include <unity.h>
+#include <string>
+#include "BridgeStats.h"
+#include "LX200Commands.h"
+
+#define GR lx200OpKey("GR")
+#define GD lx200OpKey("GD")
+
+void setUp() {
+  statsReset();
+}
+void tearDown() {}
+
+static void test_empty_is_zero() {
+  TEST_ASSERT_EQUAL(0, statsPercentile(GR, STAT_TOTAL, 50));
+  statsRecord(GR, STAT_LINK, 100);
+  TEST_ASSERT_EQUAL(0, statsPercentile(GR, STAT_TOTAL, 50));
+  TEST_ASSERT_EQUAL(0, statsPercentile(GD, STAT_LINK, 50));
+}
+
+static void test_small_values_exact() {
+  statsRecord(GR, STAT_TOTAL, 3);
+  TEST_ASSERT_EQUAL(3, statsPercentile(GR, STAT_TOTAL, 50));
+  statsRecord(GR, STAT_TOTAL, 0);
+  TEST_ASSERT_EQUAL(0, statsPercentile(GR, STAT_TOTAL, 50));
+  TEST_ASSERT_EQUAL(3, statsPercentile(GR, STAT_TOTAL, 100));
+}
+
+static void test_bucket_error_bounded() {
+  // A percentile is the top of its bucket: never below the sample, and at
+  // most a quarter above it with 4 buckets per power of two
+  for (uint32_t us = 4; us < 10000000; us = us * 3 / 2 + 1) {
+    statsReset();
+    statsRecord(GR, STAT_TOTAL, us);
+    statsRecord(GR, STAT_TOTAL, us * 10);
+    uint32_t p = statsPercentile(GR, STAT_TOTAL, 50);
+    TEST_ASSERT_TRUE(p >= us);
+    TEST_ASSERT_TRUE(p <= us + us / 4);
+  }
+}
+
+static void test_percentiles_of_range() {
+  for (uint32_t us = 1; us <= 100; us++) statsRecord(GR, STAT_TOTAL, us);
+  TEST_ASSERT_EQUAL(55, statsPercentile(GR, STAT_TOTAL, 50));   // bucket 48..55
+  TEST_ASSERT_EQUAL(100, statsPercentile(GR, STAT_TOTAL, 99));  // bucket 96..111, capped at the max
+  TEST_ASSERT_EQUAL(100, statsPercentile(GR, STAT_TOTAL, 100));
+}
+
+static void test_stages_separate() {
+  statsRecord(GR, STAT_TOTAL, 5000);
+  statsRecord(GR, STAT_UART, 1000);
+  TEST_ASSERT_EQUAL(5000, statsPercentile(GR, STAT_TOTAL, 50));
+  TEST_ASSERT_EQUAL(1000, statsPercentile(GR, STAT_UART, 50));
+  TEST_ASSERT_EQUAL(0, statsPercentile(GR, STAT_SEND, 50));
+}
+
+static void test_overflow_shares_other() {
+  for (uint32_t i = 1; i <= STATS_OPCODES; i++) statsRecord(i, STAT_TOTAL, 10);
+  statsRecord(GR, STAT_TOTAL, 10);
+  statsRecord(GD, STAT_TOTAL, 10);
+  TEST_ASSERT_EQUAL(10, statsPercentile(1, STAT_TOTAL, 50));
+  TEST_ASSERT_EQUAL(0, statsPercentile(GR, STAT_TOTAL, 50));  // not tracked on its own
+
+  char out[512];
+  std::string s(out, statsSummary(out, sizeof(out)));
+  TEST_ASSERT_TRUE(s.find("other:2,10,10,10;") != std::string::npos);
+}
+
+static void test_summary_format() {
+  statsRecord(GR, STAT_TOTAL, 100);
+  statsRecord(GR, STAT_TOTAL, 100);
+  statsRecord(GR, STAT_TOTAL, 100);
+  statsRecord(STATS_KEY_URGENT, STAT_TOTAL, 7);
+  char out[64];
+  TEST_ASSERT_EQUAL_STRING("GR:3,100,100,100;urgent:1,7,7,7;#", std::string(out, statsSummary(out, sizeof(out))).c_str());
+}
+
+static void test_summary_truncated() {
+  // Opcodes that don't fit are left off, the reply still ends in '#'
+  statsRecord(GR, STAT_TOTAL, 100);
+  statsRecord(GD, STAT_TOTAL, 100);
+  char out[24];
+  TEST_ASSERT_EQUAL_STRING("GR:1,100,100,100;#", std::string(out, statsSummary(out, sizeof(out))).c_str());
+  TEST_ASSERT_EQUAL(1, statsSummary(out, 2));
+  TEST_ASSERT_EQUAL('#', out[0]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_is_zero);
+  RUN_TEST(test_small_values_exact);
+  RUN_TEST(test_bucket_error_bounded);
+  RUN_TEST(test_percentiles_of_range);
+  RUN_TEST(test_stages_separate);
+  RUN_TEST(test_overflow_shares_other);
+  RUN_TEST(test_summary_format);
+  RUN_TEST(test_summary_truncated);
+  return UNITY_END();
+}
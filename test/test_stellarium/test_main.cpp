@@ -0,0 +1,152 @@
+// Stellarium Telescope Control against the fake Teensy: position messages
+// encoded from the prefetched replies, and goto messages decoded into
+// :Sr/:Sd, seen on the link through the session capture.
+//   pio test -e native -f test_stellarium
+
+#include <unity.h>
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "StellariumServer.h"
+#include "SessionCapture.h"
+
+#define GOTO_WAIT_MS  1000
+
+void setup();
+void loop();
+
+static int client = -1;
+
+class StringPrint : public Print {
+  public:
+    std::string text;
+    size_t write(uint8_t c) override {
+      text += (char)c;
+      return 1;
+    }
+};
+
+static void pump(unsigned long ms) {
+  unsigned long start = millis();
+  while (millis() - start < ms) loop();
+}
+
+static void putLe(uint8_t *p, uint64_t v, uint8_t bytes) {
+  for (uint8_t i = 0; i < bytes; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t getLe(const uint8_t *p, uint8_t bytes) {
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < bytes; i++) v |= (uint32_t)p[i] << (8 * i);
+  return v;
+}
+
+// Everything written to the Teensy since the last call, as one string
+static std::string teensyOut() {
+  StringPrint out;
+  captureDump();
+  while (captureDrain(out, 16)) {}
+
+  std::string sent;
+  size_t start = 0;
+  while (start < out.text.size()) {
+    size_t nl = out.text.find('\n', start);
+    std::string line = out.text.substr(start, nl - start);
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    size_t at = line.find(" <T ");
+    if (at != std::string::npos) sent += line.substr(at + 4);
+    start = nl + 1;
+  }
+  return sent;
+}
+
+// Sends a goto and runs the bridge until expect has gone to the Teensy
+static std::string sendGoto(uint32_t ra, int32_t dec, const char *expect) {
+  uint8_t msg[20];
+  putLe(msg, sizeof(msg), 2);
+  putLe(msg + 2, 0, 2);
+  putLe(msg + 4, 0, 8);
+  putLe(msg + 12, ra, 4);
+  putLe(msg + 16, (uint32_t)dec, 4);
+  teensyOut();
+  send(client, msg, sizeof(msg), 0);
+
+  std::string sent;
+  unsigned long start = millis();
+  while (millis() - start < GOTO_WAIT_MS && sent.find(expect) == std::string::npos) {
+    pump(20);
+    sent += teensyOut();
+  }
+  return sent;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_position_pushed() {
+  uint8_t msg[24];
+  size_t got = 0;
+  unsigned long start = millis();
+  while (millis() - start < 2000 && got < sizeof(msg)) {
+    loop();
+    ssize_t n = recv(client, msg + got, sizeof(msg) - got, 0);
+    if (n > 0) got += n;
+  }
+  TEST_ASSERT_EQUAL(sizeof(msg), got);
+  TEST_ASSERT_EQUAL(24, getLe(msg, 2));
+  TEST_ASSERT_EQUAL(0, getLe(msg + 2, 2));
+
+  // The fake's RA starts at 12h and runs with the clock, its Dec is fixed
+  uint32_t ra = getLe(msg + 12, 4);
+  TEST_ASSERT_TRUE(ra >= 0x80000000u && ra < 0x80000000u + 0x100000000ull / 24);
+  TEST_ASSERT_EQUAL((int32_t)((int64_t)(45 * 3600 + 30 * 60 + 15) * (1 << 30) / 324000), (int32_t)getLe(msg + 16, 4));
+  TEST_ASSERT_EQUAL(0, getLe(msg + 20, 4));
+}
+
+static void test_goto_target() {
+  std::string sent = sendGoto(0x40000000, 0x20000000, ":MS#");
+  TEST_ASSERT_TRUE_MESSAGE(sent.find(":Sr06:00:00#") != std::string::npos, sent.c_str());
+  TEST_ASSERT_TRUE_MESSAGE(sent.find(":Sd+45*00:00#") != std::string::npos, sent.c_str());
+}
+
+static void test_goto_south_rounded() {
+  // Just over 1.5 s of RA and 1.5" south, to the nearest second
+  uint32_t ra = (uint32_t)((3ull << 31) / 86400);
+  int32_t dec = -(int32_t)((1 << 30) / 324000 * 3 / 2);
+  std::string sent = sendGoto(ra + 1, dec - 1, ":MS#");
+  TEST_ASSERT_TRUE_MESSAGE(sent.find(":Sr00:00:02#") != std::string::npos, sent.c_str());
+  TEST_ASSERT_TRUE_MESSAGE(sent.find(":Sd-00*00:02#") != std::string::npos, sent.c_str());
+}
+
+static void test_goto_wraps_and_clamps() {
+  // Just short of 24h is 0h, past the pole is the pole
+  std::string sent = sendGoto(0xFFFFFFFF, 0x7FFFFFFF, ":MS#");
+  TEST_ASSERT_TRUE_MESSAGE(sent.find(":Sr00:00:00#") != std::string::npos, sent.c_str());
+  TEST_ASSERT_TRUE_MESSAGE(sent.find(":Sd+90*00:00#") != std::string::npos, sent.c_str());
+}
+
+int main() {
+  setenv("FAKE_TEENSY_FRAMES", "0", 1);  // plain text on the link, readable in the capture
+  setup();
+  pump(1500);  // session and baud negotiated
+
+  client = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(STELLARIUM_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(client, (sockaddr *)&addr, sizeof(addr)) != 0) return 1;
+  fcntl(client, F_SETFL, O_NONBLOCK);
+  pump(50);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_position_pushed);
+  RUN_TEST(test_goto_target);
+  RUN_TEST(test_goto_south_rounded);
+  RUN_TEST(test_goto_wraps_and_clamps);
+  return UNITY_END();
+}
@@ -0,0 +1,111 @@
+// LinkTimeouts: the RTO estimator, its floors and ceilings, and backoff
+//   pio test -e native -f test_timeouts
+
+#include <unity.h>
+#include "LinkTimeouts.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Each test learns its own opcodes, the tables are never cleared
+static void sample(uint32_t opKey, uint32_t firstByteUs, uint32_t replyUs, uint8_t n) {
+  for (uint8_t i = 0; i < n; i++) linkTimeoutsSample(opKey, firstByteUs, replyUs);
+}
+
+static void test_unknown_uses_ceilings() {
+  ReplyTimeouts t = linkTimeoutsFor(1);
+  TEST_ASSERT_EQUAL(LINK_FIRST_BYTE_MAX_MS, t.firstByteMs);
+  TEST_ASSERT_EQUAL(LINK_REPLY_MAX_MS, t.replyMs);
+}
+
+static void test_ceilings_until_min_samples() {
+  sample(2, 50000, 20000, LINK_TIMEOUT_MIN_SAMPLES - 1);
+  TEST_ASSERT_EQUAL(LINK_FIRST_BYTE_MAX_MS, linkTimeoutsFor(2).firstByteMs);
+  sample(2, 50000, 20000, 1);
+  TEST_ASSERT_TRUE(linkTimeoutsFor(2).firstByteMs < LINK_FIRST_BYTE_MAX_MS);
+}
+
+static void test_learned_window() {
+  // srtt 50 ms, rttvar 25 -> 18.75 -> 14.06 -> 10.55 ms: 50 + 4 * 10.55,
+  // rounded up
+  sample(3, 50000, 20000, 4);
+  TEST_ASSERT_EQUAL(93, linkTimeoutsFor(3).firstByteMs);
+  TEST_ASSERT_EQUAL(37, linkTimeoutsFor(3).replyMs);
+}
+
+static void test_floors() {
+  // A fast, steady reply still gets the floor
+  sample(4, 1000, 100, 20);
+  TEST_ASSERT_EQUAL(LINK_FIRST_BYTE_MIN_MS, linkTimeoutsFor(4).firstByteMs);
+  TEST_ASSERT_EQUAL(LINK_REPLY_MIN_MS, linkTimeoutsFor(4).replyMs);
+}
+
+static void test_slow_reply_clamped() {
+  sample(5, 5000000, 1000000, 4);
+  TEST_ASSERT_EQUAL(LINK_FIRST_BYTE_MAX_MS, linkTimeoutsFor(5).firstByteMs);
+  TEST_ASSERT_EQUAL(LINK_REPLY_MAX_MS, linkTimeoutsFor(5).replyMs);
+}
+
+static void test_jitter_widens_window() {
+  sample(6, 50000, 20000, 4);
+  for (uint8_t i = 0; i < 4; i++) {
+    linkTimeoutsSample(6, 20000, 20000);
+    linkTimeoutsSample(6, 80000, 20000);
+  }
+  TEST_ASSERT_TRUE(linkTimeoutsFor(6).firstByteMs > 93);
+}
+
+static void test_backoff_doubles_then_resets() {
+  sample(7, 50000, 20000, 4);
+  linkTimeoutsMissed(7);
+  TEST_ASSERT_EQUAL(186, linkTimeoutsFor(7).firstByteMs);
+  TEST_ASSERT_EQUAL(74, linkTimeoutsFor(7).replyMs);
+  linkTimeoutsMissed(7);
+  TEST_ASSERT_EQUAL(372, linkTimeoutsFor(7).firstByteMs);
+
+  // Capped at 16x, and at the ceiling
+  for (uint8_t i = 0; i < 10; i++) linkTimeoutsMissed(7);
+  TEST_ASSERT_EQUAL(93 << LINK_TIMEOUT_MAX_BACKOFF, linkTimeoutsFor(7).firstByteMs);
+  TEST_ASSERT_EQUAL(LINK_REPLY_MAX_MS, linkTimeoutsFor(7).replyMs);
+
+  // One reply in time brings the learned window back
+  linkTimeoutsSample(7, 50000, 20000);
+  TEST_ASSERT_TRUE(linkTimeoutsFor(7).firstByteMs < 93);
+}
+
+static void test_least_recent_evicted() {
+  for (uint32_t op = 100; op < 100 + LINK_TIMEOUT_OPCODES; op++) {
+    sample(op, 50000, 20000, 4);
+    delay(2);
+  }
+  linkTimeoutsSample(100, 50000, 20000);  // 101 is now the oldest
+  delay(2);
+  sample(200, 50000, 20000, 4);
+  TEST_ASSERT_EQUAL(LINK_FIRST_BYTE_MAX_MS, linkTimeoutsFor(101).firstByteMs);
+  TEST_ASSERT_TRUE(linkTimeoutsFor(100).firstByteMs < LINK_FIRST_BYTE_MAX_MS);
+  TEST_ASSERT_TRUE(linkTimeoutsFor(200).firstByteMs < LINK_FIRST_BYTE_MAX_MS);
+}
+
+static void test_ack_window() {
+  TEST_ASSERT_EQUAL(TEENSY_ACK_TIMEOUT, linkAckTimeout());
+  linkAckSample(15000);  // learned from the first handshake: 15 + 4 * 7.5
+  TEST_ASSERT_EQUAL(45, linkAckTimeout());
+  linkAckMissed();
+  TEST_ASSERT_EQUAL(90, linkAckTimeout());
+  linkAckSample(15000);
+  TEST_ASSERT_TRUE(linkAckTimeout() <= 45);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_unknown_uses_ceilings);
+  RUN_TEST(test_ceilings_until_min_samples);
+  RUN_TEST(test_learned_window);
+  RUN_TEST(test_floors);
+  RUN_TEST(test_slow_reply_clamped);
+  RUN_TEST(test_jitter_widens_window);
+  RUN_TEST(test_backoff_doubles_then_resets);
+  RUN_TEST(test_least_recent_evicted);
+  RUN_TEST(test_ack_window);
+  return UNITY_END();
+}
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""LX200 latency/throughput benchmark for the WiFi bridge.
+
+Runs against the real bridge (192.168.4.1) or the host-native build
+(`pio run -e native && .pio/build/native/program`, then --host 127.0.0.1).
+
+Each client repeatedly sends one poll (default SkySafari's ":GR#:GD#")
+and waits for the complete reply, timing every round-trip.
+
+  python3 tools/lx200_bench.py --host 127.0.0.1 --clients 2 --count 500
+"""
+
+import argparse
+import socket
+import threading
+import time
+
+
+def connect(host, port, timeout):
+    deadline = time.time() + timeout
+    while True:
+        try:
+            s = socket.create_connection((host, port), timeout=2)
+            s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            return s
+        except OSError:
+            if time.time() > deadline:
+                raise
+            time.sleep(0.2)
+
+
+def poll(sock, cmd, replies, timeout):
+    """Send cmd and read until `replies` '#'-terminated replies arrived."""
+    sock.sendall(cmd.encode("latin1"))
+    sock.settimeout(timeout)
+    buf = b""
+    while buf.count(b"#") < replies:
+        data = sock.recv(256)
+        if not data:
+            raise ConnectionError("bridge closed the connection")
+        buf += data
+    return buf
+
+
+def percentile(sorted_vals, p):
+    if not sorted_vals:
+        return float("nan")
+    k = min(len(sorted_vals) - 1, int(round(p / 100.0 * (len(sorted_vals) - 1))))
+    return sorted_vals[k]
+
+
+def run_client(args, results, idx, ready):
+    sock = connect(args.host, args.port, args.connect_timeout)
+    ready.wait()  # all clients connected, start timing together
+    replies = args.cmd.count("#")
+    times, errors = [], 0
+    for _ in range(args.count):
+        t0 = time.perf_counter()
+        try:
+            poll(sock, args.cmd, replies, args.timeout)
+            times.append((time.perf_counter() - t0) * 1000.0)
+        except (socket.timeout, ConnectionError):
+            errors += 1
+            sock.close()
+            sock = connect(args.host, args.port, args.connect_timeout)
+        if args.interval:
+            time.sleep(args.interval / 1000.0)
+    sock.close()
+    results[idx] = (times, errors)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--host", default="192.168.4.1")
+    ap.add_argument("--port", type=int, default=4030)
+    ap.add_argument("--cmd", default=":GR#:GD#", help="command(s) sent per round-trip")
+    ap.add_argument("--clients", type=int, default=1)
+    ap.add_argument("--count", type=int, default=200, help="round-trips per client")
+    ap.add_argument("--interval", type=float, default=0, help="ms between polls")
+    ap.add_argument("--timeout", type=float, default=3.0, help="reply timeout, s")
+    ap.add_argument("--connect-timeout", type=float, default=15.0)
+    args = ap.parse_args()
+
+    results = [None] * args.clients
+    ready = threading.Barrier(args.clients + 1)
+    threads = [threading.Thread(target=run_client, args=(args, results, i, ready)) for i in range(args.clients)]
+    for t in threads:
+        t.start()
+    ready.wait()
+    start = time.perf_counter()
+    for t in threads:
+        t.join()
+    elapsed = time.perf_counter() - start
+
+    all_times = sorted(t for r in results for t in r[0])
+    errors = sum(r[1] for r in results)
+    print(f"cmd {args.cmd!r}  clients {args.clients}  round-trips {len(all_times)}  errors {errors}")
+    print(f"throughput {len(all_times) / elapsed:.1f} polls/s")
+    print("latency ms  p50 {:.2f}  p90 {:.2f}  p99 {:.2f}  max {:.2f}".format(
+        percentile(all_times, 50), percentile(all_times, 90),
+        percentile(all_times, 99), all_times[-1] if all_times else float("nan")))
+
+
+if __name__ == "__main__":
+    main()
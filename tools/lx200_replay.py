@@ -0,0 +1,253 @@
+#!/usr/bin/env python3
+"""Replay a captured LX200 session against the WiFi bridge.
+
+The bridge records client and Teensy traffic into a ring (see
+src/SessionCapture.h). Type 'c' on its debug console and save the output,
+then replay the client side with the original timing against the native
+build (or a real bridge):
+
+  LX200_QUIET=1 .pio/build/native/program &
+  python3 tools/lx200_replay.py session.log --host 127.0.0.1
+
+Lines that are not capture records (debug output around the dump) are
+ignored. Every client in the capture gets its own connection. For each
+burst a client sent, the time to the first reply byte is measured and
+compared with the capture.
+
+By default the fake Teensy answers with its canned replies. To have it
+send the ones in the capture instead, write them out first and point the
+native build at the file:
+
+  python3 tools/lx200_replay.py session.log --teensy-script teensy.txt
+  FAKE_TEENSY_SCRIPT=teensy.txt LX200_QUIET=1 .pio/build/native/program &
+  python3 tools/lx200_replay.py session.log --host 127.0.0.1
+
+Replies are paired with their commands by the seq of the binary frames
+(src/TeensyFrames.h), so only a capture taken with frames on the link
+gives a script. On the text link nothing marks where a reply ends, and
+the canned replies are used.
+"""
+
+import argparse
+import re
+import socket
+import threading
+import time
+
+FRAME_HEAD = 0x80
+FRAME_PACKED = 0x40
+FRAME_SEQ_MASK = 0x3F
+FRAME_MAX_PAYLOAD = 48
+
+RECORD = re.compile(r"^(\d+) ([<>+-])(C(\d+)|T) ?(.*)$")
+ESCAPE = re.compile(rb"\\x([0-9A-Fa-f]{2})")
+
+
+def unescape(text):
+    return ESCAPE.sub(lambda m: bytes([int(m.group(1), 16)]), text.encode("latin1"))
+
+
+def load(path):
+    """Return the records as (seconds from the first, dir, client, bytes).
+    The Teensy side is kept with client None."""
+    records, first, last, wraps = [], None, None, 0
+    with open(path, encoding="latin1") as f:
+        for line in f:
+            m = RECORD.match(line.rstrip("\r\n"))
+            if not m:
+                continue
+            us = int(m.group(1))
+            if last is not None and us < last and last - us > 1 << 31:
+                wraps += 1  # micros() wrapped
+            last = us
+            us += wraps << 32
+            if first is None:
+                first = us
+            client = int(m.group(4)) if m.group(4) is not None else None
+            records.append(((us - first) / 1e6, m.group(2), client, unescape(m.group(5))))
+    return records
+
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE, as on the Teensy link."""
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1) & 0xFFFF
+    return crc
+
+
+def frames(chunks):
+    """Every frame with a good CRC in one direction of the Teensy link, as
+    (time, head, payload). Link control text, boot noise and frames cut by
+    the ring are skipped."""
+    data, times = b"", []
+    for t, chunk in chunks:
+        data += chunk
+        times += [t] * len(chunk)
+    out, i = [], 0
+    while i + 4 <= len(data):
+        head, n = data[i], data[i + 1]
+        end = i + 2 + n
+        if head & FRAME_HEAD and n <= FRAME_MAX_PAYLOAD and end + 2 <= len(data) and \
+                crc16(data[i:end]) == data[end] << 8 | data[end + 1]:
+            out.append((times[end + 1], head, data[i + 2:end]))
+            i = end + 2
+        else:
+            i += 1
+    return out
+
+
+def teensy_script(records):
+    """Captured (command payload, packed, reply payload) in the order the
+    Teensy answered. A reply goes to the latest command with its seq sent
+    before it."""
+    commands = frames((t, d) for t, dr, c, d in records if c is None and dr == "<")
+    replies = frames((t, d) for t, dr, c, d in records if c is None and dr == ">")
+    pending, out, ci = {}, [], 0
+    for t, head, payload in replies:
+        while ci < len(commands) and commands[ci][0] <= t:
+            pending[commands[ci][1] & FRAME_SEQ_MASK] = commands[ci][2]
+            ci += 1
+        cmd = pending.pop(head & FRAME_SEQ_MASK, None)
+        if cmd is not None:
+            out.append((cmd, bool(head & FRAME_PACKED), payload))
+    return out
+
+
+def recorded_latencies(records):
+    """Time from each client burst to the first byte sent back to it."""
+    pending, out = {}, []
+    for t, d, client, _ in records:
+        if client is None:
+            continue
+        if d == ">":
+            pending.setdefault(client, t)
+        elif d == "<" and client in pending:
+            out.append((t - pending.pop(client)) * 1000.0)
+    return out
+
+
+class Replayer:
+    def __init__(self, args):
+        self.args = args
+        self.socks = {}
+        self.sent_at = {}     # client -> time of the burst still waiting for a reply
+        self.received = {}    # client -> bytes
+        self.latencies = []
+        self.lock = threading.Lock()
+
+    def connect(self, client):
+        s = socket.create_connection((self.args.host, self.args.port), timeout=5)
+        s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        s.settimeout(None)
+        self.socks[client] = s
+        self.received.setdefault(client, b"")
+        threading.Thread(target=self.reader, args=(client, s), daemon=True).start()
+
+    def reader(self, client, s):
+        while True:
+            try:
+                data = s.recv(512)
+            except OSError:
+                return
+            if not data:
+                return
+            now = time.perf_counter()
+            with self.lock:
+                self.received[client] += data
+                t = self.sent_at.pop(client, None)
+                if t is not None:
+                    self.latencies.append((now - t) * 1000.0)
+
+    def wait_reply(self, client, timeout=2.0):
+        """At full speed, don't run ahead of the bridge: wait for the
+        reply to the previous burst, if it gets one."""
+        deadline = time.perf_counter() + timeout
+        while time.perf_counter() < deadline:
+            with self.lock:
+                if client not in self.sent_at:
+                    return
+            time.sleep(0.0002)
+        with self.lock:
+            self.sent_at.pop(client, None)  # no reply expected, e.g. :Me#
+
+    def close(self, client):
+        s = self.socks.pop(client, None)
+        if s is not None:
+            s.close()
+
+    def run(self, records):
+        start = time.perf_counter()
+        for t, d, client, data in records:
+            if client is None:
+                continue
+            if self.args.speed > 0:
+                delay = start + t / self.args.speed - time.perf_counter()
+                if delay > 0:
+                    time.sleep(delay)
+            elif d in ">-" and client in self.socks:
+                self.wait_reply(client)
+            if d == "+" or (d == ">" and client not in self.socks):
+                self.connect(client)  # the capture may start mid-session
+            if d == ">":
+                with self.lock:
+                    self.sent_at.setdefault(client, time.perf_counter())
+                self.socks[client].sendall(data)
+            elif d == "-":
+                self.close(client)
+        time.sleep(self.args.settle)
+        for client in list(self.socks):
+            self.close(client)
+
+
+def summary(name, vals):
+    vals = sorted(vals)
+    if not vals:
+        return f"{name:9s} no replies"
+    pick = lambda p: vals[min(len(vals) - 1, int(round(p / 100.0 * (len(vals) - 1))))]
+    return f"{name:9s} n {len(vals):5d}  p50 {pick(50):7.2f}  p90 {pick(90):7.2f}  p99 {pick(99):7.2f}  max {vals[-1]:7.2f} ms"
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("capture", help="debug console output containing a capture dump")
+    ap.add_argument("--host", default="127.0.0.1")
+    ap.add_argument("--port", type=int, default=4030)
+    ap.add_argument("--speed", type=float, default=1.0, help="time scale, 0 = next burst as soon as the last is answered")
+    ap.add_argument("--settle", type=float, default=1.0, help="s to wait for the last replies")
+    ap.add_argument("--teensy-script", metavar="FILE",
+                    help="write the captured Teensy replies for FAKE_TEENSY_SCRIPT and exit")
+    args = ap.parse_args()
+
+    records = load(args.capture)
+    if args.teensy_script:
+        script = teensy_script(records)
+        if not script:
+            raise SystemExit("no framed Teensy traffic in the capture, the fake Teensy can only use its canned replies")
+        with open(args.teensy_script, "w") as f:
+            for cmd, packed, reply in script:
+                f.write(f"{cmd.hex()} {int(packed)} {reply.hex()}\n")
+        print(f"{len(script)} Teensy replies written to {args.teensy_script}")
+        return
+
+    clients = sorted({c for _, _, c, _ in records if c is not None})
+    if not clients:
+        raise SystemExit("no client traffic in the capture")
+    print(f"{len(records)} records, clients {clients}, {records[-1][0]:.1f} s")
+
+    r = Replayer(args)
+    r.run(records)
+
+    print(summary("recorded", recorded_latencies(records)))
+    print(summary("replayed", r.latencies))
+    for client in clients:
+        expected = b"".join(d for _, dr, c, d in records if c == client and dr == "<")
+        got = r.received.get(client, b"")
+        print(f"client {client}: expected {len(expected)} bytes / {expected.count(b'#')} replies, "
+              f"got {len(got)} bytes / {got.count(b'#')} replies")
+
+
+if __name__ == "__main__":
+    main()